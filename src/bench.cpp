@@ -0,0 +1,633 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <map>
+#include <memory>
+
+#include "random.hpp"
+#include "clock.hpp"
+#include "input.hpp"
+#include "entity.hpp"
+#include "map.hpp"
+#include "room.hpp"
+#include "render.hpp"
+#include "spatial.hpp"
+#include "path.hpp"
+#include "visibility.hpp"
+#include "stream.hpp"
+#include "jobs.hpp"
+#include "profile.hpp"
+#include "game.hpp"
+
+//Timings of one benchmark, in nanoseconds per operation
+struct BenchResult
+{
+	std::string	name;
+	size_t		samples;
+	size_t		ops;
+	double		median;
+	double		p99;
+	double		min;
+	double		max;
+};
+
+static std::vector<BenchResult> gResults;
+
+//Keeps the compiler from throwing away the work we're timing
+static volatile size_t gSink;
+
+static double percentile( const std::vector<double>& sorted, double p )
+{
+	size_t index = (size_t)std::ceil( p * sorted.size() );
+
+	return sorted[std::min( sorted.size() - 1, index == 0 ? 0 : index - 1 )];
+}
+
+//Call fn once to warm up, then time it for a number of samples that each do ops operations
+template<typename F>
+static void runBench( const std::string& name, size_t samples, size_t ops, F fn )
+{
+	std::vector<double>	times;
+	BenchResult		result;
+	size_t			i;
+
+	fn( 0 );
+
+	for( i = 0; i < samples; i++ )
+	{
+		auto start = std::chrono::steady_clock::now();
+		fn( i + 1 );
+		auto end   = std::chrono::steady_clock::now();
+
+		times.push_back( std::chrono::duration<double, std::nano>( end - start ).count() / ops );
+	}
+
+	std::sort( times.begin(), times.end() );
+
+	result.name    = name;
+	result.samples = samples;
+	result.ops     = ops;
+	result.median  = percentile( times, 0.5 );
+	result.p99     = percentile( times, 0.99 );
+	result.min     = times.front();
+	result.max     = times.back();
+	gResults.push_back( result );
+
+	std::cout << std::left << std::setw( 32 ) << name << std::right << std::fixed << std::setprecision( 1 )
+		  << std::setw( 14 ) << result.median
+		  << std::setw( 14 ) << result.p99
+		  << std::setw( 14 ) << result.min
+		  << std::setw( 10 ) << samples << std::endl;
+}
+
+static void writeResults( const std::string& path )
+{
+	std::ofstream	out( path.c_str() );
+	size_t		i;
+
+	if( !out )
+	{
+		std::cout << "Error opening " << path << " for writing!" << std::endl;
+		return;
+	}
+
+	out << std::fixed << std::setprecision( 3 );
+	out << "{\n\t\"unit\": \"ns/op\",\n\t\"benchmarks\": [\n";
+
+	for( i = 0; i < gResults.size(); i++ )
+	{
+		const BenchResult& r = gResults[i];
+
+		out << "\t\t{ \"name\": \"" << r.name << "\", \"samples\": " << r.samples
+		    << ", \"ops\": " << r.ops << ", \"median\": " << r.median << ", \"p99\": " << r.p99
+		    << ", \"min\": " << r.min << ", \"max\": " << r.max << " }"
+		    << ( i + 1 < gResults.size() ? ",\n" : "\n" );
+	}
+
+	out << "\t]\n}\n";
+}
+
+static void benchGeneration()
+{
+	runBench( "dungeon_generate", 50, 1, []( size_t seed )
+	{
+		DungeonMap map( seed );
+		gSink += map.getTile( 256, 256 );
+	} );
+
+	//Mapping a dungeon that's already been generated and cached
+	DungeonMap cached( 1 );
+	cached.load( 1, "cache" );
+
+	runBench( "dungeon_load_cached", 50, 1, [&cached]( size_t )
+	{
+		cached.load( 1, "cache" );
+		gSink += cached.getTile( 256, 256 );
+	} );
+
+	//A batch of numbers from one stream, and a number each from lots of streams the way slimes use them
+	std::vector<sf::Uint32> numbers( 4096 );
+
+	runBench( "random_fill_4096", 50, 4096, [&numbers]( size_t sample )
+	{
+		RandomStream random( RandomStream::makeKey( 1, STREAM_ENTITY, sample ) );
+
+		random.fill( &numbers[0], numbers.size() );
+		gSink += numbers[sample];
+	} );
+
+	runBench( "random_stream_per_entity", 50, 4096, []( size_t sample )
+	{
+		for( sf::Uint64 i = 0; i < 4096; i++ )
+		{
+			RandomStream random( RandomStream::makeKey( 1, STREAM_ENTITY, i ), sample << 8 );
+			gSink += random.nextInt( 0, 3 );
+		}
+	} );
+
+	//One chunk of the unbounded dungeon, what the streaming worker does per chunk
+	runBench( "dungeon_chunk_generate", 50, 256, []( size_t sample )
+	{
+		DungeonChunk chunk;
+		int i;
+
+		for( i = 0; i < 256; i++ )
+		{
+			chunk.coord = sf::Vector2i( sample * 16 + i % 16, i / 16 );
+			ChunkStreamer::generate( 1, 32, chunk );
+			gSink += chunk.tiles[0];
+		}
+	} );
+}
+
+//Rebuilding the field for a goal that keeps moving around the floor
+static void benchFlowField( DungeonMap& map )
+{
+	FlowField			field;
+	std::vector<sf::Vector2i>	goals;
+	size_t				i, j;
+
+	for( i = 0; i < map.getWidth(); i++ )
+	{
+		for( j = 0; j < map.getHeight(); j++ )
+		{
+			if( map.getTile( i, j ) == TILE_FLOOR )
+			{
+				goals.push_back( sf::Vector2i( i, j ) );
+			}
+		}
+	}
+
+	field.resize( map );
+
+	runBench( "flow_field_build_r" + std::to_string( field.getRadius() ), 50, 1, [&]( size_t sample )
+	{
+		field.update( map, goals[( sample * 7919 ) % goals.size()] );
+	} );
+}
+
+//Paths between tiles too far apart for the flow field, searching the whole grid against planning over rooms first
+static void benchRoomPaths( DungeonMap& map )
+{
+	RoomPathfinder			pathfinder;
+	std::vector<sf::Vector2i>	floor, from, to, path;
+	size_t				i, j;
+
+	for( i = 0; i < map.getWidth(); i++ )
+	{
+		for( j = 0; j < map.getHeight(); j++ )
+		{
+			if( map.getTile( i, j ) == TILE_FLOOR )
+			{
+				floor.push_back( sf::Vector2i( i, j ) );
+			}
+		}
+	}
+
+	for( i = 0; from.size() < 64 && i < floor.size(); i++ )
+	{
+		sf::Vector2i a = floor[( i * 7919 ) % floor.size()];
+		sf::Vector2i b = floor[( i * 104729 ) % floor.size()];
+
+		if( std::abs( a.x - b.x ) + std::abs( a.y - b.y ) > 96 )
+		{
+			from.push_back( a );
+			to.push_back( b );
+		}
+	}
+
+	runBench( "path_grid_long", 64, 1, [&]( size_t sample )
+	{
+		pathfinder.findGridPath( map, sf::IntRect( 0, 0, map.getWidth(), map.getHeight() ), from[sample % from.size()], to[sample % to.size()], path );
+		gSink += path.size();
+	} );
+
+	runBench( "path_rooms_long", 64, 1, [&]( size_t sample )
+	{
+		pathfinder.findPath( map, map.getRooms(), from[sample % from.size()], to[sample % to.size()], path );
+		gSink += path.size();
+	} );
+}
+
+//Building every chunk of the map against knocking out one tile and patching just that one back in
+static void benchMapRenderer( DungeonMap& map )
+{
+	MapRenderer			renderer;
+	std::vector<sf::Vector2i>	floor;
+	size_t				i, j;
+
+	for( i = 0; i < map.getWidth(); i++ )
+	{
+		for( j = 0; j < map.getHeight(); j++ )
+		{
+			if( map.getTile( i, j ) == TILE_FLOOR )
+			{
+				floor.push_back( sf::Vector2i( i, j ) );
+			}
+		}
+	}
+
+	renderer.setTileRect( TILE_FLOOR, map.getTileRect( TILE_FLOOR ) );
+	renderer.setTileRect( TILE_ENEMY_SPAWN, map.getTileRect( TILE_ENEMY_SPAWN ) );
+	renderer.setTileRect( TILE_PLAYER_SPAWN, map.getTileRect( TILE_PLAYER_SPAWN ) );
+
+	runBench( "map_renderer_build", 20, 1, [&]( size_t )
+	{
+		renderer.build( map );
+	} );
+
+	map.clearDirty();
+
+	//Every tile goes back the way it was, so the map is left as it was found
+	runBench( "map_renderer_patch_tile", 50, 2000, [&]( size_t sample )
+	{
+		for( size_t i = 0; i < 1000; i++ )
+		{
+			sf::Vector2i tile = floor[( ( sample * 1000 ) + i ) * 7919 % floor.size()];
+
+			map.setTile( tile.x, tile.y, TILE_NONE );
+			renderer.update( map );
+			map.clearDirty();
+			map.setTile( tile.x, tile.y, TILE_FLOOR );
+			renderer.update( map );
+			map.clearDirty();
+		}
+	} );
+}
+
+//Field of view from a viewer walking around the floor, and line of sight between random floor tiles
+static void benchVisibility( DungeonMap& map )
+{
+	Visibility			sight;
+	std::vector<sf::Vector2i>	floor;
+	size_t				i, j;
+
+	for( i = 0; i < map.getWidth(); i++ )
+	{
+		for( j = 0; j < map.getHeight(); j++ )
+		{
+			if( map.getTile( i, j ) == TILE_FLOOR )
+			{
+				floor.push_back( sf::Vector2i( i, j ) );
+			}
+		}
+	}
+
+	sight.resize( map );
+
+	runBench( "fov_compute_r" + std::to_string( sight.getRadius() ), 50, 100, [&]( size_t sample )
+	{
+		for( size_t i = 0; i < 100; i++ )
+		{
+			sight.update( map, floor[( ( sample * 100 ) + i ) * 7919 % floor.size()] );
+		}
+	} );
+
+	runBench( "line_of_sight_12_tiles", 50, 10000, [&]( size_t sample )
+	{
+		size_t hits = 0;
+		for( size_t i = 0; i < 10000; i++ )
+		{
+			sf::Vector2i from = floor[( ( sample * 10000 ) + i ) * 7919 % floor.size()];
+			hits += sight.hasLineOfSight( from, from + sf::Vector2i( 12 - ( i % 25 ), 12 - ( ( i / 25 ) % 25 ) ) );
+		}
+		gSink += hits;
+	} );
+}
+
+static void benchCollision( DungeonMap& map )
+{
+	const size_t queries = 100000;
+
+	std::mt19937				rng( 1234 );
+	std::uniform_real_distribution<float>	coord( 0.0f, ( map.getWidth() - 4 ) * map.getTileSize() );
+	std::uniform_int_distribution<int>	tile( 0, map.getWidth() - 21 );
+	std::vector<sf::FloatRect>		rects;
+	std::vector<sf::Vector2i>		tiles;
+	size_t					i;
+
+	for( i = 0; i < queries; i++ )
+	{
+		rects.push_back( sf::FloatRect( coord( rng ), coord( rng ), 16.0f, 16.0f ) );
+		tiles.push_back( sf::Vector2i( tile( rng ), tile( rng ) ) );
+	}
+
+	runBench( "map_get_tile", 50, queries, [&]( size_t )
+	{
+		size_t hits = 0;
+		for( size_t i = 0; i < queries; i++ )
+		{
+			hits += map.getTile( tiles[i].x, tiles[i].y );
+		}
+		gSink += hits;
+	} );
+
+	runBench( "map_is_touching_tile_type", 50, queries, [&]( size_t )
+	{
+		size_t hits = 0;
+		for( size_t i = 0; i < queries; i++ )
+		{
+			hits += map.isTouchingTileType( TILE_NONE, rects[i] );
+		}
+		gSink += hits;
+	} );
+
+	runBench( "map_collides_with_tile", 50, queries, [&]( size_t )
+	{
+		size_t hits = 0;
+		for( size_t i = 0; i < queries; i++ )
+		{
+			hits += map.collidesWithTile( rects[i], tiles[i].x, tiles[i].y );
+		}
+		gSink += hits;
+	} );
+
+	runBench( "map_is_square_empty_20x20", 50, queries / 10, [&]( size_t )
+	{
+		size_t hits = 0;
+		for( size_t i = 0; i < queries / 10; i++ )
+		{
+			hits += map.isSquareEmpty( tiles[i].x, tiles[i].y, 20, 20 );
+		}
+		gSink += hits;
+	} );
+
+	runBench( "map_sweep", 50, queries, [&]( size_t )
+	{
+		sf::Vector2i	normal;
+		float		moved = 0.0f;
+		for( size_t i = 0; i < queries; i++ )
+		{
+			sf::Vector2f delta( ( tiles[i].x % 9 ) - 4.0f, ( tiles[i].y % 9 ) - 4.0f );
+			moved += map.sweep( rects[i], delta, normal ).x;
+		}
+		gSink += (size_t)moved;
+	} );
+}
+
+//Spread slimes over the floor of the state's map and time whole simulation steps over them
+static void benchEntities( NozokiState& state, size_t count )
+{
+	DungeonMap&			map = state.getMap();
+	std::vector<sf::Vector2f>	floor;
+	EntityStore			store;
+	SpatialHash			spatial;
+	std::vector<size_t>		found;
+	GameClock			clock;
+	TimerWheel			timers;
+	std::vector<size_t>		expired;
+	std::vector<std::vector<size_t>>	rescheduled( ( count + 1023 ) / 1024 );
+	std::vector<size_t>		all;
+	size_t				i, j;
+
+	for( i = 0; i < map.getWidth(); i++ )
+	{
+		for( j = 0; j < map.getHeight(); j++ )
+		{
+			if( map.getTile( i, j ) == TILE_FLOOR )
+			{
+				floor.push_back( map.getCoordForTile( i, j ) );
+			}
+		}
+	}
+
+	spatial.resize( map );
+	store.setIndex( &spatial );
+	store.reserve( count );
+	clock.setStep( state.getTimeStep() );
+
+	for( i = 0; i < count; i++ )
+	{
+		all.push_back( Slime::spawn( store, floor[i % floor.size()], timers, clock ) );
+	}
+
+	//Put back the timers that moved during an update, the way the game does after every step
+	auto reschedule = [&]()
+	{
+		for( auto list = rescheduled.begin(); list != rescheduled.end(); list++ )
+		{
+			for( auto it = list->begin(); it != list->end(); it++ )
+			{
+				timers.schedule( store.getHandle( *it ), store.mDeadline[*it] );
+			}
+
+			list->clear();
+		}
+	};
+
+	WorldSnapshot world;
+
+	world.map	= &map;
+	world.flowField = &state.getFlowField();
+	world.player	= map.getPlayerSpawn();
+	world.step	= state.getTimeStep();
+	world.tileSize	= map.getTileSize();
+	world.seed	= 1;
+	world.tick	= 0;
+
+	runBench( "slime_update_" + std::to_string( count ), count >= 100000 ? 20 : 50, count, [&]( size_t )
+	{
+		store.storePositions();
+		clock.advance();
+		world.tick = clock.getTick();
+		Slime::wake( world, store, timers, expired );
+		Slime::update( world, store, all.data(), all.size(), rescheduled[0] );
+		store.integrate( map, world.step, all.data(), all.size() );
+		reschedule();
+		store.updateIndex( all.data(), all.size() );
+	} );
+
+	//The same, split over every core the way the game does it
+	JobPool& jobs = state.getJobs();
+
+	runBench( "slime_update_parallel_" + std::to_string( count ), count >= 100000 ? 20 : 50, count, [&]( size_t )
+	{
+		store.storePositions();
+		clock.advance();
+		world.tick = clock.getTick();
+		Slime::wake( world, store, timers, expired );
+		jobs.parallelFor( store.size(), 1024, [&]( size_t first, size_t last )
+		{
+			Slime::update( world, store, &all[first], last - first, rescheduled[first / 1024] );
+			store.integrate( map, world.step, &all[first], last - first );
+		} );
+		reschedule();
+		store.updateIndex( all.data(), all.size() );
+	} );
+
+	//The same slimes with only those near a player standing on the spawn simulated, the way the game does it.
+	//Timed per step, which goes with how many are near rather than how many there are
+	SimulationLod		lod;
+	std::vector<size_t>	due;
+
+	lod.setRadius( 32 * map.getTileSize() );
+	lod.reset( store );
+
+	runBench( "slime_update_lod_" + std::to_string( count ), count >= 100000 ? 20 : 50, 1, [&]( size_t )
+	{
+		store.storePositions();
+		clock.advance();
+		world.tick = clock.getTick();
+		lod.update( store, spatial, timers, world.player, world.tick, due );
+		Slime::wake( world, store, timers, expired );
+		Slime::update( world, store, due.data(), due.size(), rescheduled[0] );
+		store.integrate( map, world.step, due.data(), due.size() );
+		reschedule();
+		store.updateIndex( due.data(), due.size() );
+	} );
+
+	//The same number of slimes again, all inside the field and chasing a player standing on the spawn
+	FlowField&		  field = state.getFlowField();
+	EntityStore		  chasers;
+	TimerWheel		  chaseTimers;
+	std::vector<size_t>	  ids;
+	std::vector<sf::Vector2f> reached;
+
+	field.resize( map );
+	field.update( map, map.getTileCoordForPoint( map.getPlayerSpawn() ) );
+
+	for( auto it = floor.begin(); it != floor.end(); it++ )
+	{
+		if( field.getDistance( map.getTileCoordForPoint( *it ) ) != FlowField::UNREACHED )
+		{
+			reached.push_back( *it );
+		}
+	}
+
+	chasers.reserve( count );
+
+	for( i = 0; i < count; i++ )
+	{
+		ids.push_back( Slime::spawn( chasers, reached[i % reached.size()], chaseTimers, clock ) );
+	}
+
+	for( auto it = ids.begin(); it != ids.end(); it++ )
+	{
+		chasers.mState[*it] = ENEMY_CHASING;
+	}
+
+	runBench( "slime_chase_" + std::to_string( count ), count >= 100000 ? 20 : 50, count, [&]( size_t )
+	{
+		chasers.storePositions();
+		Slime::update( world, chasers, ids.data(), ids.size(), expired );
+		expired.clear();
+		chasers.integrate( map, world.step, ids.data(), ids.size() );
+	} );
+
+	//Detection-sized queries around points on the floor
+	runBench( "spatial_query_radius_" + std::to_string( count ), 50, 1000, [&]( size_t sample )
+	{
+		for( size_t i = 0; i < 1000; i++ )
+		{
+			found.clear();
+			spatial.queryRadius( floor[( ( sample * 1000 ) + ( i * 7919 ) ) % floor.size()], 8 * 16.0f, found );
+			gSink += found.size();
+		}
+	} );
+}
+
+int main( int argc, char **argv )
+{
+	std::string	outPath = "bench.json";
+	int		i;
+
+	for( i = 1; i < argc; i++ )
+	{
+		if( std::strcmp( argv[i], "--out" ) == 0 && i + 1 < argc )
+		{
+			outPath = argv[++i];
+		}
+	}
+
+	//Nothing here opens a window or touches a texture, so this runs headless
+	Game		game;
+	NozokiState	state( &game );
+	DungeonMap	map( 1 );
+
+	state.setSeed( 1 );
+	state.load();
+	state.getJobs().resize( 0 );
+
+	std::cout << std::left << std::setw( 32 ) << "benchmark" << std::right
+		  << std::setw( 14 ) << "median ns/op"
+		  << std::setw( 14 ) << "p99 ns/op"
+		  << std::setw( 14 ) << "min ns/op"
+		  << std::setw( 10 ) << "samples" << std::endl;
+
+	benchGeneration();
+	benchCollision( map );
+	benchFlowField( map );
+	benchRoomPaths( map );
+	benchVisibility( map );
+	benchMapRenderer( map );
+	benchEntities( state, 1000 );
+	benchEntities( state, 10000 );
+	benchEntities( state, 100000 );
+
+	writeResults( outPath );
+
+	return 0;
+}
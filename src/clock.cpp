@@ -0,0 +1,158 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+#include <vector>
+#include <algorithm>
+
+#include "clock.hpp"
+
+GameClock::GameClock()
+{
+	mStep	= 0.0f;
+	mScale	= 1.0f;
+	mPaused = false;
+	reset();
+}
+
+void GameClock::reset()
+{
+	mTime = 0.0f;
+	mTick = 0;
+}
+
+//Move on by one step, scaled. Does nothing while paused
+void GameClock::advance()
+{
+	if( mPaused )
+	{
+		return;
+	}
+
+	mTime += getStep();
+	mTick++;
+}
+
+TimerWheel::TimerWheel()
+{
+	reset( 0 );
+}
+
+//Drop every timer and start counting from the given step
+void TimerWheel::reset( sf::Uint64 now )
+{
+	int i, j;
+
+	for( i = 0; i < LEVELS; i++ )
+	{
+		for( j = 0; j < SLOTS; j++ )
+		{
+			mSlots[i][j].clear();
+		}
+	}
+
+	mFar.clear();
+	mNow   = now;
+	mCount = 0;
+}
+
+//Have an id come back out of advance on the given step, or the next one if that's already been
+void TimerWheel::schedule( size_t id, sf::Uint64 deadline )
+{
+	Timer timer = { id, std::max( deadline, mNow + 1 ) };
+
+	place( timer );
+	mCount++;
+}
+
+//The finest wheel whose slots above it are the same for now and the deadline
+void TimerWheel::place( const Timer& timer )
+{
+	int level;
+
+	for( level = 0; level < LEVELS; level++ )
+	{
+		int shift = SLOT_BITS * ( level + 1 );
+
+		if( ( timer.deadline >> shift ) == ( mNow >> shift ) )
+		{
+			mSlots[level][( timer.deadline >> ( shift - SLOT_BITS ) ) & ( SLOTS - 1 )].push_back( timer );
+			return;
+		}
+	}
+
+	//Further out than every wheel put together, looked at again each time the last one comes round
+	mFar.push_back( timer );
+}
+
+//Empty a slot into the wheels below it. The slot and the scratch list trade buffers rather than
+//giving them up, so once every slot has grown to what it needs this never allocates
+void TimerWheel::cascade( std::vector<Timer>& slot )
+{
+	mCascade.swap( slot );
+
+	for( auto it = mCascade.begin(); it != mCascade.end(); it++ )
+	{
+		place( *it );
+	}
+
+	mCascade.clear();
+}
+
+//Step forwards to the given step, adding the ids of every timer that fired on the way to expired
+void TimerWheel::advance( sf::Uint64 now, std::vector<size_t>& expired )
+{
+	int level;
+
+	while( mNow < now )
+	{
+		mNow++;
+
+		if( ( mNow & ( ( (sf::Uint64)1 << ( SLOT_BITS * LEVELS ) ) - 1 ) ) == 0 )
+		{
+			cascade( mFar );
+		}
+
+		//Coarse slots that just became current move down a wheel, coarsest first so they can keep going
+		for( level = LEVELS - 1; level > 0; level-- )
+		{
+			if( ( mNow & ( ( (sf::Uint64)1 << ( SLOT_BITS * level ) ) - 1 ) ) == 0 )
+			{
+				cascade( mSlots[level][( mNow >> ( SLOT_BITS * level ) ) & ( SLOTS - 1 )] );
+			}
+		}
+
+		std::vector<Timer>& slot = mSlots[0][mNow & ( SLOTS - 1 )];
+
+		for( auto it = slot.begin(); it != slot.end(); it++ )
+		{
+			expired.push_back( it->id );
+		}
+
+		mCount -= slot.size();
+		slot.clear();
+	}
+}
@@ -0,0 +1,92 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+//The simulation's own time, advanced once per step. Everything that animates or waits reads it
+//instead of the OS clock, so it all stops when the game is paused and slows down with it
+class GameClock
+{
+public:
+	GameClock();
+	void		reset();
+	void		advance();
+	void		setStep( float step ) { mStep = step; }
+	void		setPaused( bool paused ) { mPaused = paused; }
+	void		setScale( float scale ) { mScale = scale; }
+	bool		isPaused() const { return mPaused; }
+	float		getTime() const { return mTime; }
+	float		getStep() const { return mStep * mScale; }
+	sf::Uint64	getTick() const { return mTick; }
+	sf::Uint64	getDeadline( float seconds ) const { return mTick + toTicks( seconds, getStep() ); }
+
+	//Steps it takes to wait a number of seconds, at least one so a timer never fires on the step that set it
+	static sf::Uint64 toTicks( float seconds, float step ) { return std::max<sf::Uint64>( 1, (sf::Uint64)( seconds / step + 0.5f ) ); }
+
+private:
+	float		mTime;
+	float		mStep;
+	float		mScale;
+	sf::Uint64	mTick;
+	bool		mPaused;
+};
+
+//Timers for a lot of ids, bucketed by the step they fire on across a few wheels of 64 slots each.
+//A timer sits in the coarsest wheel that can tell it apart from now and drops to a finer one as its
+//step gets closer, so a step only ever looks at the timers that fire on it and the odd slot moving down.
+//Timers can't be cancelled, the owner of an id has to ignore any that fire for a deadline it no longer has
+class TimerWheel
+{
+public:
+	TimerWheel();
+	void		reset( sf::Uint64 );
+	void		schedule( size_t, sf::Uint64 );
+	void		advance( sf::Uint64, std::vector<size_t>& );
+	size_t		size() const { return mCount; }
+
+private:
+	struct Timer
+	{
+		size_t		id;
+		sf::Uint64	deadline;
+	};
+
+	static const int	LEVELS	  = 4;
+	static const int	SLOT_BITS = 6;
+	static const int	SLOTS	  = 1 << SLOT_BITS;
+
+	void		place( const Timer& );
+	void		cascade( std::vector<Timer>& );
+
+	std::vector<Timer>	mSlots[LEVELS][SLOTS];
+	std::vector<Timer>	mFar;
+	std::vector<Timer>	mCascade;
+	sf::Uint64		mNow;
+	size_t			mCount;
+};
+
+#endif
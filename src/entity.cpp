@@ -29,319 +29,800 @@
 #include <SFML/System.hpp>
 
 #include <iostream>
-
+#include <string>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <memory>
+
+#include "random.hpp"
+#include "resource.hpp"
 #include "map.hpp"
+#include "room.hpp"
+#include "spatial.hpp"
+#include "clock.hpp"
+#include "input.hpp"
 #include "entity.hpp"
+#include "path.hpp"
+#include "visibility.hpp"
+#include "render.hpp"
+#include "stream.hpp"
+#include "jobs.hpp"
+#include "profile.hpp"
 #include "game.hpp"
 
-Delay::Delay( sf::Time time )
+Animation::Animation( int delay )
 {
-	mDuration = time;
+	setDelay( delay );
+	mStart = 0.0f;
 }
 
-bool Delay::elapsed()
+Animation::Animation( int delay, sf::Sprite a, sf::Sprite b )
 {
-	return ( mClock.getElapsedTime() >= mDuration );
+	setDelay( delay );
+	mFrames.push_back( a );
+	mFrames.push_back( b );
+	mStart = 0.0f;
 }
 
-void Delay::setDuration( sf::Time time )
+void Animation::addFrame( sf::Sprite sprite )
 {
-	mDuration = time;
+	mFrames.push_back( sprite );
 }
 
-void Delay::reset()
+//Figure out the correct sprite for a time on the game clock, in seconds
+sf::Sprite& Animation::getCurrentFrame( float time )
 {
-	mClock.restart();
+	size_t frame = (size_t)( std::max( 0.0f, time - mStart ) * 1000.0f / mDelay );
+
+	return mFrames[frame % mFrames.size()];
 }
 
-Animation::Animation( int delay )
+void Animation::setDelay( int delay )
 {
-	setDelay( delay );
-	mCurrentFrame = 0;
+	mDelay = delay;
 }
 
-Animation::Animation( int delay, sf::Sprite a, sf::Sprite b )
+//Start again from the first frame at the given time
+void Animation::reset( float time )
 {
-	setDelay( delay );
-	mFrames.push_back( a );
-	mFrames.push_back( b );
-	mCurrentFrame = 0;
+	mStart = time;
 }
 
-void Animation::addFrame( sf::Sprite sprite )
+const size_t EntityStore::NO_ENTITY;
+
+EntityStore::EntityStore()
 {
-	mFrames.push_back( sprite );
+	mAllocations = 0;
+	mIndex	     = NULL;
 }
 
-//Figure out the correct sprite to return this frame of the animation
-sf::Sprite& Animation::getCurrentFrame()
+//Keep the given spatial index up to date as entities are created and moved
+void EntityStore::setIndex( SpatialHash *index )
 {
-	if( mClock.getElapsedTime().asMilliseconds() >= mDelay )
+	mIndex = index;
+}
+
+//Add an entity with every component set to a neutral value and return its id
+size_t EntityStore::create( sf::Uint8 kind, sf::Vector2f position, sf::Vector2f size )
+{
+	sf::Uint32 slot;
+
+	//Growing the arrays is the only time the store allocates, reserve enough up front and it never does
+	if( mKind.size() == mKind.capacity() )
 	{
-		mClock.restart();
-		mCurrentFrame++;
+		mAllocations++;
+	}
+
+	//Reuse the most recently freed slot, its generation has already moved on from the last entity in it
+	if( !mFreeSlots.empty() )
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = mSlotIndex.size();
+		mSlotIndex.push_back( 0 );
+		mSlotGeneration.push_back( 1 );
+	}
 
-		if( mCurrentFrame == mFrames.size() )
+	mSlotIndex[slot] = mKind.size();
+	mHandles.push_back( ( (sf::Uint64)mSlotGeneration[slot] << 32 ) | slot );
+	mKind.push_back( kind );
+	mState.push_back( 0 );
+	mDirection.push_back( DIRECTION_DOWN );
+	mPosition.push_back( position );
+	mPrevPosition.push_back( position );
+	mVelocity.push_back( sf::Vector2f( 0.0f, 0.0f ) );
+	mContact.push_back( sf::Vector2i( 0, 0 ) );
+	mSize.push_back( size );
+	mDeadline.push_back( 0 );
+	mDelay.push_back( 0.0f );
+	mStride.push_back( 1 );
+
+	if( mIndex != NULL )
+	{
+		mIndex->update( mKind.size() - 1, position );
+	}
+
+	return mKind.size() - 1;
+}
+
+//Remove an entity in constant time by moving the last one into its place. Handles to the one
+//that moved still find it, handles to the one removed stop working
+void EntityStore::destroy( size_t id )
+{
+	size_t	   last = size() - 1;
+	sf::Uint32 slot = mHandles[id] & 0xffffffff;
+
+	mSlotGeneration[slot]++;
+	mFreeSlots.push_back( slot );
+
+	if( mIndex != NULL )
+	{
+		mIndex->remove( id );
+	}
+
+	if( id != last )
+	{
+		mKind[id]	  = mKind[last];
+		mState[id]	  = mState[last];
+		mDirection[id]	  = mDirection[last];
+		mPosition[id]	  = mPosition[last];
+		mPrevPosition[id] = mPrevPosition[last];
+		mVelocity[id]	  = mVelocity[last];
+		mContact[id]	  = mContact[last];
+		mSize[id]	  = mSize[last];
+		mDeadline[id]	  = mDeadline[last];
+		mDelay[id]	  = mDelay[last];
+		mStride[id]	  = mStride[last];
+		mHandles[id]	  = mHandles[last];
+
+		mSlotIndex[mHandles[id] & 0xffffffff] = id;
+
+		if( mIndex != NULL )
 		{
-			mCurrentFrame = 0;
+			mIndex->remove( last );
+			mIndex->update( id, mPosition[id] );
 		}
 	}
 
-	return mFrames[mCurrentFrame];
+	mKind.pop_back();
+	mState.pop_back();
+	mDirection.pop_back();
+	mPosition.pop_back();
+	mPrevPosition.pop_back();
+	mVelocity.pop_back();
+	mContact.pop_back();
+	mSize.pop_back();
+	mDeadline.pop_back();
+	mDelay.pop_back();
+	mStride.pop_back();
+	mHandles.pop_back();
 }
 
-void Animation::setDelay( int delay )
+//Where an entity is now, or NO_ENTITY once it's been destroyed
+size_t EntityStore::getIndex( EntityHandle handle ) const
 {
-	mClock.restart();
-	mDelay = delay;
+	sf::Uint32 slot = handle & 0xffffffff;
+
+	if( slot >= mSlotGeneration.size() || mSlotGeneration[slot] != ( handle >> 32 ) )
+	{
+		return NO_ENTITY;
+	}
+
+	return mSlotIndex[slot];
 }
 
-void Animation::reset()
+//Put an entity somewhere without it being drawn sliding there
+void EntityStore::setPosition( size_t id, sf::Vector2f position )
 {
-	mClock.restart();
-	mCurrentFrame = 0;
+	mPosition[id]	  = position;
+	mPrevPosition[id] = position;
+
+	if( mIndex != NULL )
+	{
+		mIndex->update( id, position );
+	}
 }
 
-Player::Player()
+void EntityStore::reserve( size_t count )
 {
-	mState = PLAYER_IDLE;
-	mWalkSpeed = 75;
-	mScale.x = 16.0f;
-	mScale.y = 16.0f;
+	mKind.reserve( count );
+	mState.reserve( count );
+	mDirection.reserve( count );
+	mPosition.reserve( count );
+	mPrevPosition.reserve( count );
+	mVelocity.reserve( count );
+	mContact.reserve( count );
+	mSize.reserve( count );
+	mDeadline.reserve( count );
+	mDelay.reserve( count );
+	mStride.reserve( count );
+	mHandles.reserve( count );
+	mSlotIndex.reserve( count );
+	mSlotGeneration.reserve( count );
+	mFreeSlots.reserve( count );
 }
 
-//Return the right sprite depending on state
-sf::Sprite& Player::getSprite()
+//Throw away every entity at once, keeping the memory for the next level. Every slot in use is
+//freed, so handles from before never match anything created after
+void EntityStore::clear()
 {
-	switch( mState )
+	size_t i;
+
+	for( i = 0; i < mHandles.size(); i++ )
 	{
-	case PLAYER_IDLE:
-		return mIdleSprites[mDirection];
+		sf::Uint32 slot = mHandles[i] & 0xffffffff;
 
-	case PLAYER_WALKING:
-		return mWalkingAnims[mDirection].getCurrentFrame();
+		mSlotGeneration[slot]++;
+		mFreeSlots.push_back( slot );
+	}
+
+	mHandles.clear();
+	mKind.clear();
+	mState.clear();
+	mDirection.clear();
+	mPosition.clear();
+	mPrevPosition.clear();
+	mVelocity.clear();
+	mContact.clear();
+	mSize.clear();
+	mDeadline.clear();
+	mDelay.clear();
+	mStride.clear();
+
+	if( mIndex != NULL )
+	{
+		mIndex->clear();
 	}
 }
 
-void Player::update( GameState *gs )
+//Move everything by offset and destroy whatever ends up outside keep, apart from the player
+void EntityStore::translate( sf::Vector2f offset, sf::FloatRect keep )
 {
-	NozokiState *state = (NozokiState*)gs;
+	size_t i;
 
-	//Do movement
-	if( !sf::Keyboard::isKeyPressed( sf::Keyboard::Up) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Down ) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Right ) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Left ) )
+	for( i = 0; i < size(); i++ )
 	{
-		mVelocity = sf::Vector2f( 0, 0 );
-		setState( PLAYER_IDLE );
-		
+		mPosition[i]	 += offset;
+		mPrevPosition[i] += offset;
 	}
 
-	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Right ) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Left ) )
+	//Backwards, so whatever gets moved into a hole has already been looked at
+	for( i = size(); i-- > 0; )
 	{
-		setState( PLAYER_WALKING );
-		mDirection = DIRECTION_RIGHT;
-		mVelocity = sf::Vector2f( mWalkSpeed, 0 );
+		if( mKind[i] != ENTITY_PLAYER && !keep.contains( mPosition[i] ) )
+		{
+			destroy( i );
+		}
 	}
 
-	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Left ) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Right ) )
+	if( mIndex != NULL )
 	{
-		setState( PLAYER_WALKING );
-		mDirection = DIRECTION_LEFT;
-		mVelocity = sf::Vector2f( -mWalkSpeed, 0 );
+		mIndex->clear();
+
+		for( i = 0; i < size(); i++ )
+		{
+			mIndex->update( i, mPosition[i] );
+		}
 	}
+}
+
+//Remember where everything was before a simulation step, for interpolating between steps
+void EntityStore::storePositions()
+{
+	std::copy( mPosition.begin(), mPosition.end(), mPrevPosition.begin() );
+}
+
+//Move the count entities in ids by as many steps as their stride, sliding along whatever walls they run
+//into, and note which way those walls face in their contact. This only touches those entities so lists
+//of them can be integrated in parallel, the spatial index is caught up after with updateIndex
+void EntityStore::integrate( const Map& map, float step, const size_t *ids, size_t count )
+{
+	size_t i;
 
-	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Up ) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Down ) )
+	for( i = 0; i < count; i++ )
 	{
-		setState( PLAYER_WALKING );
-		mDirection = DIRECTION_UP;
-		mVelocity = sf::Vector2f( 0, -mWalkSpeed );
+		size_t id = ids[i];
+
+		if( mVelocity[id].x == 0.0f && mVelocity[id].y == 0.0f )
+		{
+			mContact[id] = sf::Vector2i( 0, 0 );
+			continue;
+		}
+
+		mPosition[id] += map.sweep( getAABB( id ), mVelocity[id] * ( step * mStride[id] ), mContact[id] );
 	}
+}
 
-	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Down ) &&
-	    !sf::Keyboard::isKeyPressed( sf::Keyboard::Up ) )
+//Rebucket the entities in ids that have moved since the last step
+void EntityStore::updateIndex( const size_t *ids, size_t count )
+{
+	size_t i;
+
+	if( mIndex == NULL )
 	{
-		setState( PLAYER_WALKING );
-		mDirection = DIRECTION_DOWN;
-		mVelocity = sf::Vector2f( 0, mWalkSpeed );
+		return;
 	}
 
-	//Move only if we won't hit something we shouldn't
-	if( !state->getMap().isTouchingTileType( TILE_NONE, sf::FloatRect( mPosition + ( mVelocity * ( state->getDelta() / 1000.0f ) ), mScale ) ) )
+	for( i = 0; i < count; i++ )
 	{
-		mPosition += ( mVelocity * ( state->getDelta() / 1000.0f ) );
+		if( mPosition[ids[i]] != mPrevPosition[ids[i]] )
+		{
+			mIndex->update( ids[i], mPosition[ids[i]] );
+		}
 	}
-	
-	//Update the actual sprite
-	getSprite().setPosition( mPosition );
 }
 
-void Player::loadResources()
+sf::Vector2f EntityStore::getInterpolatedPosition( size_t id, float alpha ) const
+{
+	return mPrevPosition[id] + ( ( mPosition[id] - mPrevPosition[id] ) * alpha );
+}
+
+const sf::Uint8 SimulationLod::THROTTLE_STRIDE;
+
+SimulationLod::SimulationLod()
+{
+	mRadius	    = 0.0f;
+	mRooms	    = NULL;
+	mTileSize   = 1.0f;
+	mPlayerArea = RoomGraph::NO_AREA;
+}
+
+//The rooms of the level being played and how big its tiles are. An empty graph or NULL falls back to
+//the radius for everything
+void SimulationLod::setRooms( const RoomGraph *rooms, float tileSize )
+{
+	mRooms	  = ( rooms && !rooms->empty() ) ? rooms : NULL;
+	mTileSize = tileSize;
+	setPlayerArea( RoomGraph::NO_AREA );
+}
+
+//Put everything to sleep and forget what was near, for after entities have been added or destroyed
+//wholesale. Whatever's near gets woken again by the next update
+void SimulationLod::reset( EntityStore& store )
+{
+	std::fill( store.mStride.begin(), store.mStride.end(), 0 );
+	mNear.clear();
+}
+
+//The area a point is in, NO_AREA if there are no rooms or it's outside all of them
+size_t SimulationLod::findArea( sf::Vector2f point ) const
+{
+	if( !mRooms )
+	{
+		return RoomGraph::NO_AREA;
+	}
+
+	return mRooms->findArea( sf::Vector2i( (int)std::floor( point.x / mTileSize ), (int)std::floor( point.y / mTileSize ) ) );
+}
+
+//List the player's area and every area a portal out of it leads to, only when the player's moved to
+//another area
+void SimulationLod::setPlayerArea( size_t area )
+{
+	size_t i;
+
+	if( area == mPlayerArea )
+	{
+		return;
+	}
+
+	mPlayerArea = area;
+	mActiveAreas.clear();
+
+	if( area == RoomGraph::NO_AREA )
+	{
+		return;
+	}
+
+	const size_t *nodes = mRooms->getNodes( area );
+
+	mActiveAreas.push_back( area );
+
+	//The other side of a portal is the node next to this one
+	for( i = 0; i < mRooms->getNodeCount( area ); i++ )
+	{
+		size_t other = mRooms->getNodeArea( nodes[i] ^ 1 );
+
+		if( std::find( mActiveAreas.begin(), mActiveAreas.end(), other ) == mActiveAreas.end() )
+		{
+			mActiveAreas.push_back( other );
+		}
+	}
+}
+
+//Set the stride of everything near the player for this step and fill due with the ones to run. Only
+//what's near is looked at, so this costs the same however many entities are asleep
+void SimulationLod::update( EntityStore& store, const SpatialHash& spatial, TimerWheel& timers, sf::Vector2f player, sf::Uint64 tick, std::vector<size_t>& due )
+{
+	size_t i;
+
+	due.clear();
+
+	if( mRadius <= 0.0f )
+	{
+		for( i = 0; i < store.size(); i++ )
+		{
+			store.mStride[i] = 1;
+			due.push_back( i );
+		}
+		return;
+	}
+
+	//Whatever was near last step goes back to sleep, unless it's still near
+	for( auto it = mNear.begin(); it != mNear.end(); it++ )
+	{
+		store.mStride[*it] = 0;
+	}
+
+	//Sorting these by id costs more than it saves. The order the spatial hash gives them in only depends
+	//on where things have been, so it's the same every run however many threads there are
+	mNear.clear();
+	spatial.queryRadius( player, mRadius * 2.0f, mNear );
+	setPlayerArea( findArea( player ) );
+
+	for( auto it = mNear.begin(); it != mNear.end(); it++ )
+	{
+		sf::Vector2f offset = store.mPosition[*it] - player;
+		size_t	     area   = mActiveAreas.empty() ? RoomGraph::NO_AREA : findArea( store.mPosition[*it] + ( store.mSize[*it] / 2.0f ) );
+		bool	     close;
+
+		//Anything no area covers goes by distance, as everything does while the player is somewhere like that
+		if( area == RoomGraph::NO_AREA )
+		{
+			close = ( offset.x * offset.x ) + ( offset.y * offset.y ) <= mRadius * mRadius;
+		}
+		else
+		{
+			close = std::find( mActiveAreas.begin(), mActiveAreas.end(), area ) != mActiveAreas.end();
+		}
+
+		store.mStride[*it] = close ? 1 : THROTTLE_STRIDE;
+
+		//A slime that slept through its timer picks what to do next as soon as it's woken
+		if( store.mKind[*it] == ENTITY_SLIME && store.mState[*it] != ENEMY_CHASING && store.mDeadline[*it] == 0 )
+		{
+			store.mDeadline[*it] = tick + 1;
+			timers.schedule( store.getHandle( *it ), store.mDeadline[*it] );
+		}
+
+		//Throttled entities take turns, so about the same share of them runs every step
+		if( close || ( tick + *it ) % THROTTLE_STRIDE == 0 )
+		{
+			due.push_back( *it );
+		}
+	}
+}
+
+Player::Player()
+{
+	mWalkSpeed = 75;
+	mHandle	   = 0;
+}
+
+void Player::spawn( EntityStore& store, sf::Vector2f position )
+{
+	size_t id = store.create( ENTITY_PLAYER, position, sf::Vector2f( 16.0f, 16.0f ) );
+
+	store.mState[id] = PLAYER_IDLE;
+	mHandle = store.getHandle( id );
+}
+
+//Return the right sprite depending on state, and the game clock's time for animating
+sf::Sprite& Player::getSprite( const EntityStore& store, float time )
 {
-	if( !mTexture.loadFromFile( "res/basictiles.png", sf::IntRect( 0, 9 * 16, 8 * 16, 16 ) ) )
+	size_t id = getId( store );
+
+	switch( store.mState[id] )
 	{
-		std::cout << "Error loading textures from res/basictiles.png!" << std::endl;
+	case PLAYER_WALKING:
+		return mWalkingAnims[store.mDirection[id]].getCurrentFrame( time );
+
+	default:
+		return mIdleSprites[store.mDirection[id]];
 	}
+}
 
-	mIdleSprites[DIRECTION_RIGHT] = sf::Sprite( mTexture, sf::IntRect( 2 * 16, 0, 16, 16 ) );
-	mIdleSprites[DIRECTION_LEFT] = sf::Sprite( mTexture, sf::IntRect( 6 * 16, 0, 16, 16 ) );
-	mIdleSprites[DIRECTION_UP] = sf::Sprite( mTexture, sf::IntRect( 4 * 16, 0, 16, 16 ) );
-	mIdleSprites[DIRECTION_DOWN] = sf::Sprite( mTexture, sf::IntRect( 1 * 16, 0, 16, 16 ) );
+//Turn the buttons held this step into our entity's velocity, the store does the actual moving
+void Player::update( NozokiState *state, InputState input )
+{
+	EntityStore&	store	  = state->getEntities();
+	size_t		id	  = getId( store );
+	sf::Vector2f&	velocity  = store.mVelocity[id];
+	sf::Uint8&	direction = store.mDirection[id];
+
+	//Do movement
+	if( !( input & ( INPUT_UP | INPUT_DOWN | INPUT_LEFT | INPUT_RIGHT ) ) )
+	{
+		velocity = sf::Vector2f( 0, 0 );
+		store.mState[id] = PLAYER_IDLE;
+		
+	}
+
+	if( ( input & INPUT_RIGHT ) && !( input & INPUT_LEFT ) )
+	{
+		store.mState[id] = PLAYER_WALKING;
+		direction = DIRECTION_RIGHT;
+		velocity = sf::Vector2f( mWalkSpeed, 0 );
+	}
+
+	if( ( input & INPUT_LEFT ) && !( input & INPUT_RIGHT ) )
+	{
+		store.mState[id] = PLAYER_WALKING;
+		direction = DIRECTION_LEFT;
+		velocity = sf::Vector2f( -mWalkSpeed, 0 );
+	}
+
+	if( ( input & INPUT_UP ) && !( input & INPUT_DOWN ) )
+	{
+		store.mState[id] = PLAYER_WALKING;
+		direction = DIRECTION_UP;
+		velocity = sf::Vector2f( 0, -mWalkSpeed );
+	}
+
+	if( ( input & INPUT_DOWN ) && !( input & INPUT_UP ) )
+	{
+		store.mState[id] = PLAYER_WALKING;
+		direction = DIRECTION_DOWN;
+		velocity = sf::Vector2f( 0, mWalkSpeed );
+	}
+}
+
+//The player's frames are all on row 9 of the tile sheet
+void Player::loadResources()
+{
+	const std::string sheet = "res/basictiles.png";
+
+	mIdleSprites[DIRECTION_RIGHT] = gResources.getSprite( sheet, sf::IntRect( 2 * 16, 9 * 16, 16, 16 ) );
+	mIdleSprites[DIRECTION_LEFT] = gResources.getSprite( sheet, sf::IntRect( 6 * 16, 9 * 16, 16, 16 ) );
+	mIdleSprites[DIRECTION_UP] = gResources.getSprite( sheet, sf::IntRect( 4 * 16, 9 * 16, 16, 16 ) );
+	mIdleSprites[DIRECTION_DOWN] = gResources.getSprite( sheet, sf::IntRect( 1 * 16, 9 * 16, 16, 16 ) );
 
 	mWalkingAnims[DIRECTION_RIGHT] = Animation( 300, 
-						    sf::Sprite( mTexture, sf::IntRect( 3 * 16, 0, 16, 16 ) ),
-						    sf::Sprite( mTexture, sf::IntRect( 2 * 16, 0, 16, 16 ) ) );
+						    gResources.getSprite( sheet, sf::IntRect( 3 * 16, 9 * 16, 16, 16 ) ),
+						    gResources.getSprite( sheet, sf::IntRect( 2 * 16, 9 * 16, 16, 16 ) ) );
 
 	mWalkingAnims[DIRECTION_LEFT] = Animation( 300, 
-						    sf::Sprite( mTexture, sf::IntRect( 6 * 16, 0, 16, 16 ) ),
-						    sf::Sprite( mTexture, sf::IntRect( 7 * 16, 0, 16, 16 ) ) );
+						    gResources.getSprite( sheet, sf::IntRect( 6 * 16, 9 * 16, 16, 16 ) ),
+						    gResources.getSprite( sheet, sf::IntRect( 7 * 16, 9 * 16, 16, 16 ) ) );
 
 	mWalkingAnims[DIRECTION_UP] = Animation( 300, 
-						    sf::Sprite( mTexture, sf::IntRect( 5 * 16, 0, 16, 16 ) ),
-						    sf::Sprite( mTexture, sf::IntRect( 4 * 16, 0, 16, 16 ) ) );
+						    gResources.getSprite( sheet, sf::IntRect( 5 * 16, 9 * 16, 16, 16 ) ),
+						    gResources.getSprite( sheet, sf::IntRect( 4 * 16, 9 * 16, 16, 16 ) ) );
 
 	mWalkingAnims[DIRECTION_DOWN] = Animation( 300, 
-						    sf::Sprite( mTexture, sf::IntRect( 0 * 16, 0, 16, 16 ) ),
-						    sf::Sprite( mTexture, sf::IntRect( 1 * 16, 0, 16, 16 ) ) );
+						    gResources.getSprite( sheet, sf::IntRect( 0 * 16, 9 * 16, 16, 16 ) ),
+						    gResources.getSprite( sheet, sf::IntRect( 1 * 16, 9 * 16, 16, 16 ) ) );
 }
 
-bool		Slime::mTextureInit = false;
-sf::Texture	Slime::mTexture;
-float		Slime::mSpeed	    = 30.0f;
+float		Slime::mSpeed     = 30.0f;
+float		Slime::mChaseSpeed   = 45.0f;
+float		Slime::mFrameTime = 0.3f;
+sf::Sprite	Slime::mIdleSprite;
+sf::Sprite	Slime::mWalkFrames[2];
 
-Slime::Slime( sf::Vector2f pos ) :
-	mMoveDelay( sf::seconds( 3.0f ) )
+size_t Slime::spawn( EntityStore& store, sf::Vector2f position, TimerWheel& timers, const GameClock& clock )
 {
-	mPosition   = pos;
-	mVelocity.x = 0.0f;
-	mVelocity.y = 0.0f;
-	mScale.x    = 16.0f;
-	mScale.y    = 16.0f;
-	mDirection  = DIRECTION_LEFT;
-	mState	    = ENEMY_IDLE;
-	loadResources();
+	size_t id = store.create( ENTITY_SLIME, position, sf::Vector2f( 16.0f, 16.0f ) );
+
+	store.mState[id]     = ENEMY_IDLE;
+	store.mDirection[id] = DIRECTION_LEFT;
+	store.mDelay[id]     = 3.0f;
+	store.mDeadline[id]  = clock.getDeadline( store.mDelay[id] );
+	timers.schedule( store.getHandle( id ), store.mDeadline[id] );
+
+	return id;
 }
 
+//Every slime shares the same frames, through the resource cache
 void Slime::loadResources()
 {
-	if( !mTextureInit )
+	const std::string sheet = "res/basictiles.png";
+
+	mWalkFrames[0] = gResources.getSprite( sheet, sf::IntRect( 0, 12 * 16, 16, 16 ) );
+	mWalkFrames[1] = gResources.getSprite( sheet, sf::IntRect( 16, 12 * 16, 16, 16 ) );
+	mIdleSprite    = gResources.getSprite( sheet, sf::IntRect( 0, 12 * 16, 16, 16 ) );
+}
+
+//Slimes face left in the sheet, so they're flipped to face right
+sf::Sprite Slime::getSprite( const EntityStore& store, size_t id, float time )
+{
+	sf::Sprite sprite;
+
+	if( store.mState[id] == ENEMY_IDLE )
 	{
-		if( !mTexture.loadFromFile( "res/basictiles.png", sf::IntRect( 0, 12 * 16, 3 * 16, 16 ) ) )
+		sprite = mIdleSprite;
+	}
+	else
+	{
+		sprite = mWalkFrames[(int)( time / mFrameTime ) % 2];
+	}
+
+	if( store.mDirection[id] == DIRECTION_RIGHT )
+	{
+		sprite.setScale( -1.0f, 1.0f );
+	}
+
+	return sprite;
+}
+
+//Fire the slime timers that are up this step, so only the slimes whose wait or walk just ended get
+//looked at. Timers are kept by handle. Runs on the main thread before update, expired is just somewhere to put them
+void Slime::wake( const WorldSnapshot& world, EntityStore& store, TimerWheel& timers, std::vector<size_t>& expired )
+{
+	expired.clear();
+	timers.advance( world.tick, expired );
+
+	for( auto it = expired.begin(); it != expired.end(); it++ )
+	{
+		size_t id = store.getIndex( *it );
+
+		//Left over from a slime that's gone or a deadline that has since moved
+		if( id == EntityStore::NO_ENTITY || store.mDeadline[id] != world.tick )
+		{
+			continue;
+		}
+
+		store.mDeadline[id] = 0;
+
+		//Sleeping slimes let it lapse, they get a new one when they're woken
+		if( store.mStride[id] == 0 )
+		{
+			continue;
+		}
+
+		//Chasing slimes don't wander, they get a new timer when they give up
+		if( store.mKind[id] == ENTITY_SLIME && store.mState[id] != ENEMY_CHASING )
 		{
-			std::cout << "Error loading textures from res/basictiles.png!" << std::endl;
+			wander( world, store, id );
+			timers.schedule( *it, store.mDeadline[id] );
 		}
-		mTextureInit == true;
 	}
-	mWalkAnim = Animation( 300,
-			       sf::Sprite( mTexture, sf::IntRect( 0, 0, 16, 16 ) ),
-			       sf::Sprite( mTexture, sf::IntRect( 16, 0, 16, 16 ) ) );
-	mIdleSprite = sf::Sprite( mTexture, sf::IntRect( 0, 0, 16, 16 ) );
 }
 
-sf::Sprite& Slime::getSprite()
+//Run the AI of the count slimes in ids that are doing more than waiting on their timer. Only writes
+//to those slimes, so lists of them can be run on different threads. Any slime whose timer moves is
+//added to rescheduled, for the main thread to put back on the wheel once every list is done
+void Slime::update( const WorldSnapshot& world, EntityStore& store, const size_t *ids, size_t count, std::vector<size_t>& rescheduled )
 {
-	switch( mState )
+	size_t n;
+
+	for( n = 0; n < count; n++ )
 	{
-	case ENEMY_IDLE:
-		switch( mDirection )
+		size_t i = ids[n];
+
+		if( store.mKind[i] != ENTITY_SLIME )
 		{
-		case DIRECTION_RIGHT:
-			mIdleSprite.setScale( -1.0f, 1.0f );
-			return mIdleSprite;
-			
-		case DIRECTION_LEFT:
-			mIdleSprite.setScale( 1.0f, 1.0f );
-			return mIdleSprite;
+			continue;
+		}
 
-		case DIRECTION_UP:
-			return mIdleSprite;
+		if( store.mState[i] == ENEMY_CHASING )
+		{
+			chase( world, store, i, rescheduled );
+			continue;
+		}
 
-		case DIRECTION_DOWN:
-			return mIdleSprite;
+		//Wandering into a wall ends the walk early
+		if( store.mState[i] == ENEMY_WALKING && store.mContact[i] != sf::Vector2i( 0, 0 ) && store.mDeadline[i] > world.tick + 1 )
+		{
+			store.mDeadline[i] = world.tick + 1;
+			rescheduled.push_back( i );
 		}
-		break;
+	}
+}
 
-	case ENEMY_WALKING:
-		switch( mDirection )
+//A slime's timer ran out, start walking somewhere or stop and wait a while. Its random numbers come
+//from a stream per slime and step, so they don't depend on what else fired this step. The stream is
+//keyed by handle, ids move around whenever something else in the store is destroyed
+void Slime::wander( const WorldSnapshot& world, EntityStore& store, size_t i )
+{
+	RandomStream random( RandomStream::makeKey( world.seed, STREAM_ENTITY, store.getHandle( i ) ), world.tick << 8 );
+
+	switch( store.mState[i] )
+	{
+	case ENEMY_IDLE:
+		store.mState[i]	    = ENEMY_WALKING;
+		store.mDirection[i] = random.nextInt( 0, 3 );
+
+		switch( store.mDirection[i] )
 		{
 		case DIRECTION_RIGHT:
-			mWalkAnim.getCurrentFrame().setScale( -1.0f, 1.0f );
-			return mWalkAnim.getCurrentFrame();
-			
+			store.mVelocity[i].x = mSpeed;
+			break;
+
 		case DIRECTION_LEFT:
-			mWalkAnim.getCurrentFrame().setScale( 1.0f, 1.0f );
-			return mWalkAnim.getCurrentFrame();
+			store.mVelocity[i].x = -mSpeed;
+			break;
 			
 		case DIRECTION_UP:
-			return mWalkAnim.getCurrentFrame();
+			store.mVelocity[i].y = mSpeed;
+			break;
 			
 		case DIRECTION_DOWN:
-			return mWalkAnim.getCurrentFrame();
-
+			store.mVelocity[i].y = -mSpeed;
+			break;
 		}
 		break;
+
+	case ENEMY_WALKING:
+		store.mDelay[i]	   = random.nextInt( 1, 5 );
+		store.mVelocity[i] = sf::Vector2f( 0, 0 );
+		store.mState[i]	   = ENEMY_IDLE;
+		break;
 	}
+
+	store.mDeadline[i] = world.tick + GameClock::toTicks( store.mDelay[i], world.step );
 }
 
-void Slime::update( GameState *gs )
+//Start chasing the player with every slime in ids that's standing in the player's field of view
+void Slime::notice( EntityStore& store, const std::vector<size_t>& ids, const Visibility& sight, float tileSize )
 {
-	NozokiState *state = (NozokiState*)gs;
+	for( auto it = ids.begin(); it != ids.end(); it++ )
+	{
+		sf::Vector2f center = store.mPosition[*it] + ( store.mSize[*it] / 2.0f );
+
+		if( store.mKind[*it] == ENTITY_SLIME &&
+		    sight.isVisible( sf::Vector2i( center.x / tileSize, center.y / tileSize ) ) )
+		{
+			store.mState[*it] = ENEMY_CHASING;
+		}
+	}
+}
 
-	std::uniform_int_distribution<int> dirRand( 0, 3 );
-	std::uniform_int_distribution<int> delayRand( 1, 5 );
+//Follow the flow field towards the player, giving up once we're outside of it
+void Slime::chase( const WorldSnapshot& world, EntityStore& store, size_t id, std::vector<size_t>& rescheduled )
+{
+	const FlowField& field	  = *world.flowField;
+	float		 tileSize = world.tileSize;
+	sf::Vector2f	 center	  = store.mPosition[id] + ( store.mSize[id] / 2.0f );
+	sf::Vector2i	 tile( center.x / tileSize, center.y / tileSize );
+	int		 direction = field.getDirection( tile );
 
-	switch( mState )
+	if( direction == NO_DIRECTION )
 	{
-	case ENEMY_IDLE:
-		if( mMoveDelay.elapsed() )
+		store.mVelocity[id] = sf::Vector2f( 0, 0 );
+
+		//Only the player's own tile has a distance but no direction, there we close in on the player itself
+		if( field.getDistance( tile ) == 0 )
 		{
-			mMoveDelay.reset();
-			mState = ENEMY_WALKING;
-			mDirection = dirRand( gRanNumGen );
-
-			switch( mDirection )
-			{
-			case DIRECTION_RIGHT:
-				mVelocity.x = mSpeed;
-				break;
-
-			case DIRECTION_LEFT:
-				mVelocity.x = -mSpeed;
-				break;
-				
-			case DIRECTION_UP:
-				mVelocity.y = mSpeed;
-				break;
-				
-			case DIRECTION_DOWN:
-				mVelocity.y = -mSpeed;
-				break;
-			}
-		}
-		break;
+			sf::Vector2f offset = world.player - center;
 
-	case ENEMY_WALKING:
-		if( mMoveDelay.elapsed() )
+			store.mVelocity[id].x = std::max( -mChaseSpeed, std::min( mChaseSpeed, offset.x * 4.0f ) );
+			store.mVelocity[id].y = std::max( -mChaseSpeed, std::min( mChaseSpeed, offset.y * 4.0f ) );
+		}
+		else
 		{
-			mMoveDelay.reset();
-			mMoveDelay.setDuration( sf::seconds( delayRand( gRanNumGen ) ) );
-			mVelocity = sf::Vector2f( 0, 0 );
-			mState = ENEMY_IDLE;
+			store.mState[id]    = ENEMY_IDLE;
+			store.mDeadline[id] = world.tick + GameClock::toTicks( store.mDelay[id], world.step );
+			rescheduled.push_back( id );
 		}
-		break;
+		return;
 	}
-	
-	sf::FloatRect aabb( mPosition + ( mVelocity * ( state->getDelta() / 1000.0f ) ), mScale );
 
-	if( state->getMap().isInsideMap( aabb ) && !state->getMap().isTouchingTileType( TILE_NONE, aabb ) )
+	sf::Vector2i step = FlowField::getStep( direction );
+	sf::Vector2f tileCenter( ( tile.x + 0.5f ) * tileSize, ( tile.y + 0.5f ) * tileSize );
+
+	store.mDirection[id] = direction;
+	store.mVelocity[id]  = sf::Vector2f( step.x * mChaseSpeed, step.y * mChaseSpeed );
+
+	//Drift towards the middle of the tile on the other axis so we don't catch on corners
+	if( step.x != 0 )
 	{
-		mPosition += ( mVelocity * ( state->getDelta() / 1000.0f ) );
-	} 
-	
-	getSprite().setPosition( mPosition );
+		store.mVelocity[id].y = std::max( -mChaseSpeed, std::min( mChaseSpeed, ( tileCenter.y - center.y ) * 4.0f ) );
+	}
+	else
+	{
+		store.mVelocity[id].x = std::max( -mChaseSpeed, std::min( mChaseSpeed, ( tileCenter.x - center.x ) * 4.0f ) );
+	}
 }
-
@@ -29,6 +29,11 @@
 
 class GameState;
 class NozokiState;
+class Map;
+class RoomGraph;
+class SpatialHash;
+class FlowField;
+class Visibility;
 
 enum {
 	PLAYER_IDLE,
@@ -48,96 +53,162 @@ enum {
 	DIRECTION_DOWN	= 3
 };
 
-class Delay
-{
-public:
-	Delay( sf::Time );
-	bool elapsed();
-	void reset();
-	void setDuration( sf::Time );
+enum {
+	ENTITY_PLAYER,
+	ENTITY_SLIME
+};
 
-private:
-	sf::Time mDuration;
-	sf::Clock mClock;
+//Everything the AI gets to look at during a step. None of it changes while entities are being
+//updated, so any number of threads can read it at once
+struct WorldSnapshot
+{
+	const Map	*map;
+	const FlowField	*flowField;
+	sf::Vector2f	 player;
+	float		 step;
+	float		 tileSize;
+	unsigned int	 seed;
+	sf::Uint64	 tick;
 };
 
-//Base animation class, takes a sequence of sprites and will return the appropriate one
+//Base animation class, takes a sequence of sprites and picks one from the game clock's time
 class Animation
 {
 public:
 	Animation( int = 1000 );
 	Animation( int, sf::Sprite, sf::Sprite );
-	sf::Sprite&	getCurrentFrame();
+	sf::Sprite&	getCurrentFrame( float );
 	void		addFrame( sf::Sprite );
 	void		setDelay( int );
-	void		reset();
+	void		reset( float );
 
 private:
 	std::vector<sf::Sprite>	mFrames;
-	int			mCurrentFrame;
 	bool			mLoop;
 	int			mDelay;
-	sf::Clock		mClock;
+	float			mStart;
 };
 
-//Base entity class
-class Entity
+//Refers to one entity for as long as it's alive, wherever it gets moved to in the store. The low half
+//is a slot and the high half that slot's generation, which goes up every time the slot is freed
+typedef sf::Uint64 EntityHandle;
+
+//Every entity in a level, stored as one contiguous array per component and indexed by entity id.
+//Ids are packed, destroying one moves the last entity into its place, so anything held on to across
+//steps should be a handle instead
+class EntityStore
 {
 public:
-	virtual void update( GameState * ) {}
-	virtual sf::Sprite& getSprite()	= 0;
-	virtual void loadResources()	= 0;
-	virtual void setDirection( int direction ) { mDirection	= direction; }
-	virtual void setPosition( sf::Vector2f position ) { mPosition = position; }
-	virtual sf::Vector2f getPosition() { return mPosition; }
-	virtual void move( sf::Vector2f offset ) { mPosition += offset; }
-	virtual void handleEvent( sf::Event ) {}
-	virtual sf::FloatRect getAABB() { return sf::FloatRect( mPosition,  mScale ); }
-	virtual sf::Vector2f getScale() { return mScale; }
-	virtual sf::Vector2f getVelocity() { return mVelocity; }
-
-protected:
-	int		mState;
-	sf::Vector2f	mPosition;
-	int		mDirection;
-	sf::Vector2f	mScale;
-	sf::Vector2f	mVelocity;
+	EntityStore();
+	size_t		create( sf::Uint8, sf::Vector2f, sf::Vector2f );
+	void		destroy( size_t );
+	EntityHandle getHandle( size_t id ) const { return mHandles[id]; }
+	size_t		getIndex( EntityHandle ) const;
+	bool isAlive( EntityHandle handle ) const { return getIndex( handle ) != NO_ENTITY; }
+	size_t getAllocationCount() const { return mAllocations; }
+	void		setIndex( SpatialHash * );
+	void		setPosition( size_t, sf::Vector2f );
+	void		reserve( size_t );
+	void		clear();
+	void		translate( sf::Vector2f, sf::FloatRect );
+	size_t		size() const { return mKind.size(); }
+	void		storePositions();
+	void		integrate( const Map&, float, const size_t *, size_t );
+	void		updateIndex( const size_t *, size_t );
+	sf::FloatRect	getAABB( size_t id ) const { return sf::FloatRect( mPosition[id], mSize[id] ); }
+	sf::Vector2f	getInterpolatedPosition( size_t, float ) const;
+
+	std::vector<sf::Uint8>		mKind;
+	std::vector<sf::Uint8>		mState;
+	std::vector<sf::Uint8>		mDirection;
+	std::vector<sf::Vector2f>	mPosition;
+	std::vector<sf::Vector2f>	mPrevPosition;
+	std::vector<sf::Vector2f>	mVelocity;
+	std::vector<sf::Vector2i>	mContact;
+	std::vector<sf::Vector2f>	mSize;
+	std::vector<sf::Uint64>		mDeadline;
+	std::vector<float>		mDelay;
+	std::vector<sf::Uint8>		mStride;
+
+	static const size_t		NO_ENTITY = (size_t)-1;
+
+private:
+	std::vector<EntityHandle>	mHandles;
+	std::vector<sf::Uint32>		mSlotIndex;
+	std::vector<sf::Uint32>		mSlotGeneration;
+	std::vector<sf::Uint32>		mFreeSlots;
+	size_t				mAllocations;
+	SpatialHash			*mIndex;
 };
 
-//Our player
-class Player : public Entity
+//Picks which entities get simulated each step by where they are from the player, so a big dungeon
+//costs about what a small one does. Those in the player's room or a room joined to it by a portal
+//run every step and the rest out to twice the radius take turns running every few steps, each run
+//covering the steps in between at once. Anything further sleeps where it is, slimes letting their
+//timers lapse until they're woken. Without rooms, on a streamed dungeon say, the radius decides what
+//runs every step instead. A radius of 0 runs everything every step
+class SimulationLod
+{
+public:
+	SimulationLod();
+	void	setRadius( float radius ) { mRadius = radius; }
+	float getRadius() const { return mRadius; }
+	void	setRooms( const RoomGraph *, float );
+	void	reset( EntityStore& );
+	void	update( EntityStore&, const SpatialHash&, TimerWheel&, sf::Vector2f, sf::Uint64, std::vector<size_t>& );
+
+	static const sf::Uint8	THROTTLE_STRIDE = 4;
+
+private:
+	size_t	findArea( sf::Vector2f ) const;
+	void	setPlayerArea( size_t );
+
+	float			mRadius;
+	const RoomGraph		*mRooms;
+	float			mTileSize;
+	size_t			mPlayerArea;
+	std::vector<size_t>	mActiveAreas;
+	std::vector<size_t>	mNear;
+};
+
+//Our player, drives its own entity in the store from the keyboard
+class Player
 {
 public:
 	Player();
-	void		update( GameState * );
-	sf::Sprite& getSprite();
-	void loadResources();
-	void setState( int state ) { mState = state; }
-	void setVelocity( sf::Vector2f vel ) { mVelocity = vel; }
-	sf::Vector2f getVelocity() { return mVelocity; }
+	void		spawn( EntityStore&, sf::Vector2f );
+	void		update( NozokiState *, InputState );
+	sf::Sprite&	getSprite( const EntityStore&, float );
+	void		loadResources();
+	size_t getId( const EntityStore& store ) const { return store.getIndex( mHandle ); }
 	int mWalkSpeed;
  
 private:
-	sf::Texture	mTexture;
+	EntityHandle	mHandle;
 	sf::Sprite	mIdleSprites[4];
 	Animation	mWalkingAnims[4];
 };
 
-class Slime : public Entity
+//Slime behaviour, run over every slime in an entity store at once
+class Slime
 {
 public:
-	Slime( sf::Vector2f );
-	virtual sf::Sprite& getSprite();
-	virtual void loadResources();
-	virtual void update( GameState * );
+	static size_t		spawn( EntityStore&, sf::Vector2f, TimerWheel&, const GameClock& );
+	static void		loadResources();
+	static void		wake( const WorldSnapshot&, EntityStore&, TimerWheel&, std::vector<size_t>& );
+	static void		update( const WorldSnapshot&, EntityStore&, const size_t *, size_t, std::vector<size_t>& );
+	static void		notice( EntityStore&, const std::vector<size_t>&, const Visibility&, float );
+	static sf::Sprite	getSprite( const EntityStore&, size_t, float );
 
 private:
-	static sf::Texture	mTexture;
-	static bool		mTextureInit;
+	static void		wander( const WorldSnapshot&, EntityStore&, size_t );
+	static void		chase( const WorldSnapshot&, EntityStore&, size_t, std::vector<size_t>& );
+
 	static float		mSpeed;
-	Animation		mWalkAnim;
-	sf::Sprite		mIdleSprite;
-	Delay			mMoveDelay;
+	static float		mChaseSpeed;
+	static float		mFrameTime;
+	static sf::Sprite	mIdleSprite;
+	static sf::Sprite	mWalkFrames[2];
 };
 
 #endif
@@ -29,15 +29,153 @@
 #include <SFML/System.hpp>
 #include <vector>
 #include <iostream>
-
+#include <string>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <memory>
+#include <fstream>
+
+#include "random.hpp"
+#include "resource.hpp"
+#include "clock.hpp"
+#include "input.hpp"
 #include "entity.hpp"
 #include "map.hpp"
+#include "room.hpp"
+#include "level.hpp"
+#include "render.hpp"
+#include "spatial.hpp"
+#include "path.hpp"
+#include "visibility.hpp"
+#include "stream.hpp"
+#include "jobs.hpp"
+#include "profile.hpp"
 #include "game.hpp"
 
-Game::Game() : mNozState( this )
+Game::Game() : mNozState( this ), mLoadingState( this ), mSimulating( false )
 {
 	mWindowWidth  = 800;
 	mWindowHeight = 600;
+	mMaxFrameTime = sf::milliseconds( 250 );
+	mShowProfile  = false;
+	setSimulationRate( 60 );
+}
+
+//Show or hide the frame time overlay, the zones it's showing are listed on the console
+void Game::toggleProfile()
+{
+#ifdef NOZOKI_PROFILE
+	mShowProfile = !mShowProfile;
+
+	if( mShowProfile )
+	{
+		gProfiler.printStats();
+	}
+#else
+	std::cout << "Profiling isn't compiled in, rebuild with make PROFILE=1" << std::endl;
+#endif
+}
+
+//Save the last few seconds of zones to trace.json for a trace viewer
+void Game::saveTrace()
+{
+#ifdef NOZOKI_PROFILE
+	if( gProfiler.writeTrace( "trace.json" ) )
+	{
+		std::cout << "Wrote trace.json" << std::endl;
+	}
+#else
+	std::cout << "Profiling isn't compiled in, rebuild with make PROFILE=1" << std::endl;
+#endif
+}
+
+//Log every step's input while playing and save it to a file once the window closes
+void Game::setRecording( const std::string& path )
+{
+	mRecordPath = path;
+	mNozState.setRecording( true );
+}
+
+//Play a recorded session back without a window, as fast as it'll go, timing every step. The step times
+//also go to a CSV if there's a path for one. Returns what main should exit with, 2 if the replay diverged
+int Game::replay( const std::string& path, const std::string& timingsPath )
+{
+	std::vector<double>	times;
+	size_t			i, slowest = 0;
+	double			total = 0.0;
+
+	if( !mNozState.setReplay( path ) )
+	{
+		return 1;
+	}
+
+	InputLog& log = mNozState.getInputLog();
+
+	setSimulationRate( log.getTickRate() );
+	mNozState.setHeadless( true );
+	mNozState.load();
+	mNozState.initState();
+
+	times.reserve( log.getTickCount() );
+
+	for( i = 0; i < log.getTickCount(); i++ )
+	{
+		auto start = std::chrono::steady_clock::now();
+		mNozState.update();
+		auto end   = std::chrono::steady_clock::now();
+
+		times.push_back( std::chrono::duration<double, std::milli>( end - start ).count() );
+		total += times.back();
+
+		if( times[i] > times[slowest] )
+		{
+			slowest = i;
+		}
+	}
+
+	if( !timingsPath.empty() )
+	{
+		std::ofstream out( timingsPath.c_str() );
+
+		out << "tick,ms" << std::endl;
+
+		for( i = 0; i < times.size(); i++ )
+		{
+			out << i << "," << times[i] << "\n";
+		}
+	}
+
+	bool matches = mNozState.getChecksum() == log.getChecksum();
+
+	std::cout << "Replayed " << times.size() << " steps of dungeon " << log.getSeed() << " in " << total << "ms" << std::endl;
+
+	if( !times.empty() )
+	{
+		double worst = times[slowest];
+
+		std::sort( times.begin(), times.end() );
+		std::cout << "Per step: median " << times[times.size() / 2] << "ms, p99 " << times[( times.size() - 1 ) * 99 / 100]
+			  << "ms, max " << worst << "ms at step " << slowest << std::endl;
+	}
+
+	std::cout << ( matches ? "Ended where the recording did" : "Diverged from the recording!" ) << std::endl;
+
+	return matches ? 0 : 2;
+}
+
+//How many times per second the game logic runs, regardless of how fast we render. Kept to a step
+//of at least a microsecond, a step of nothing would never catch up
+void Game::setSimulationRate( unsigned int rate )
+{
+	mTimeStep = sf::microseconds( 1000000 / std::min( std::max( rate, 1u ), 1000000u ) );
 }
 
 void Game::openWindow()
@@ -46,40 +184,142 @@ void Game::openWindow()
 	mWindow->setVerticalSyncEnabled(true);
 }
 
-int GameState::getDelta()
+float GameState::getTimeStep()
 {
-	return mParent->getDelta();
+	return mParent->getTimeStep();
 }
 
 //Main loop
 void Game::doLoop()
 {
-	openWindow();
+	//Start building the level while the window is still being created
+	mLoadingState.setNext( &mNozState );
+	setState( &mLoadingState );
 
-	setState( &mNozState );
+	openWindow();
 
 	mWindow->setKeyRepeatEnabled( false );
 
-	mFrameTime = mDeltaClock.restart().asMilliseconds();
+	mAccumulator = sf::Time::Zero;
+	mDeltaClock.restart();
 
 	while( mWindow->isOpen() )
 	{
 		mState->handleInput();
 
+		//Don't try to catch up on more than a few steps after a long hitch
+		mFrameTime = std::min( mDeltaClock.restart(), mMaxFrameTime );
+
 		mWindow->clear( sf::Color::Black );
 
-		mState->doFrame();
+		//A simulation on its own thread keeps its own time and the state works out how far between steps it is
+		if( mSimulating )
+		{
+			mState->draw( 0.0f );
+		}
+		else
+		{
+			GameState *state = mState;
+
+			mAccumulator += mFrameTime;
+
+			//Run the simulation in fixed steps until it has caught up with real time. A step can switch
+			//to another state, which may already be stepping itself on its own thread, so stop there
+			while( mAccumulator >= mTimeStep && mState == state )
+			{
+				mState->update();
+				mAccumulator -= mTimeStep;
+			}
+
+			//Draw however far we are between the last two steps, a state we just switched to waits a frame
+			if( mState == state )
+			{
+				mState->draw( mAccumulator / mTimeStep );
+			}
+			else
+			{
+				mAccumulator = sf::Time::Zero;
+			}
+		}
+
+		if( mShowProfile )
+		{
+			mProfileOverlay.update( gProfiler );
+			mWindow->setView( mWindow->getDefaultView() );
+			mWindow->draw( mProfileOverlay );
+		}
 
-		mWindow->display();
+		{
+			PROFILE_ZONE( "display" );
+			mWindow->display();
+		}
 
-		mFrameTime = mDeltaClock.restart().asMilliseconds();
+		PROFILE_END_FRAME();
+	}
+
+	stopSimulation();
+
+	//Keep the session so it can be replayed
+	if( !mRecordPath.empty() )
+	{
+		InputLog& log = mNozState.getInputLog();
+
+		log.setChecksum( mNozState.getChecksum() );
+
+		if( log.save( mRecordPath ) )
+		{
+			std::cout << "Recorded " << log.getTickCount() << " steps of dungeon " << log.getSeed() << " to " << mRecordPath << std::endl;
+		}
 	}
 }
 
 void Game::setState( GameState *state )
 {
+	stopSimulation();
 	state->initState();
 	mState = state;
+
+	//Stepping the state doesn't have to wait for a frame to be presented, or the other way around
+	if( state->isThreaded() )
+	{
+		mSimulating = true;
+		mSimulation = std::thread( &Game::simulate, this );
+	}
+}
+
+//The simulation thread, steps the state at the fixed rate and publishes what it ends up with for drawing.
+//It sleeps off whatever's left until the next step is due
+void Game::simulate()
+{
+	sf::Clock clock;
+	sf::Time  accumulator = sf::Time::Zero;
+
+	while( mSimulating )
+	{
+		accumulator += std::min( clock.restart(), mMaxFrameTime );
+
+		if( accumulator >= mTimeStep )
+		{
+			while( accumulator >= mTimeStep )
+			{
+				mState->update();
+				accumulator -= mTimeStep;
+			}
+
+			mState->publish();
+		}
+
+		sf::sleep( mTimeStep - accumulator );
+	}
+}
+
+void Game::stopSimulation()
+{
+	if( mSimulation.joinable() )
+	{
+		mSimulating = false;
+		mSimulation.join();
+	}
 }
 
 GameState::GameState( Game *parent )
@@ -87,53 +327,486 @@ GameState::GameState( Game *parent )
 	mParent = parent;
 }
 
+//Entities per job when updating them in parallel
+static const size_t ENTITY_GRAIN = 1024;
+
+//Room for this many entities is made when a level starts, so spawning doesn't allocate until there are more
+static const size_t ENTITY_RESERVE = 4096;
+
+LoadingState::LoadingState( Game *parent ) : GameState( parent ), mNextAsset( 0 ), mLoaded( false )
+{
+	mNext	  = NULL;
+	mUploaded = 0;
+}
+
+LoadingState::~LoadingState()
+{
+	join();
+}
+
+//Kick off the workers, one builds the next state's level and the rest decode its images
+void LoadingState::initState()
+{
+	size_t i, decoders;
+
+	mClock.restart();
+	mPaths.clear();
+	mNext->getAssets( mPaths );
+	mImages.assign( mPaths.size(), sf::Image() );
+	mDecoded.clear();
+	mNextAsset = 0;
+	mLoaded	   = false;
+	mUploaded  = 0;
+
+	mWorkers.push_back( std::thread( [this]()
+	{
+		mNext->load();
+		mLoaded = true;
+	} ) );
+
+	//Leave a core for the level, but always have at least one decoder
+	decoders = std::min<size_t>( mPaths.size(), std::thread::hardware_concurrency() - 1 );
+	decoders = std::max<size_t>( decoders, 1 );
+
+	for( i = 0; i < decoders; i++ )
+	{
+		mWorkers.push_back( std::thread( &LoadingState::decodeAssets, this ) );
+	}
+}
+
+//Worker side, decodes images until there are none left and queues them up to be uploaded
+void LoadingState::decodeAssets()
+{
+	size_t i;
+
+	while( ( i = mNextAsset++ ) < mPaths.size() )
+	{
+		if( !mImages[i].loadFromFile( mPaths[i] ) )
+		{
+			std::cout << "Error loading image from " << mPaths[i] << "!" << std::endl;
+		}
+
+		std::lock_guard<std::mutex> lock( mMutex );
+		mDecoded.push_back( i );
+	}
+}
+
+void LoadingState::join()
+{
+	for( auto it = mWorkers.begin(); it != mWorkers.end(); it++ )
+	{
+		it->join();
+	}
+
+	mWorkers.clear();
+}
+
+//Everything that's done counts the same, the level and each image
+float LoadingState::getProgress()
+{
+	return ( mUploaded + ( mLoaded ? 1.0f : 0.0f ) ) / ( mPaths.size() + 1 );
+}
+
+//Upload whatever has been decoded since last time, and once it's all in switch over
+void LoadingState::update()
+{
+	std::vector<size_t> decoded;
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		decoded.swap( mDecoded );
+	}
+
+	for( auto it = decoded.begin(); it != decoded.end(); it++ )
+	{
+		gResources.addTexture( mPaths[*it], mImages[*it] );
+		mImages[*it] = sf::Image();
+		mUploaded++;
+	}
+
+	if( !mLoaded || mUploaded < mPaths.size() )
+	{
+		return;
+	}
+
+	join();
+	std::cout << "Loaded in " << mClock.getElapsedTime().asMilliseconds() << "ms" << std::endl;
+
+	mParent->setState( mNext );
+}
+
+//A bar across the middle of the screen that fills up as things finish
+void LoadingState::draw( float )
+{
+	sf::RenderWindow   *window = mParent->mWindow;
+	sf::Vector2f	    size( window->getSize().x / 2.0f, 16.0f );
+	sf::Vector2f	    position( window->getSize().x / 4.0f, ( window->getSize().y - size.y ) / 2.0f );
+	sf::RectangleShape  frame( size );
+	sf::RectangleShape  bar( sf::Vector2f( size.x * getProgress(), size.y ) );
+
+	window->setView( window->getDefaultView() );
+
+	frame.setPosition( position );
+	frame.setFillColor( sf::Color::Transparent );
+	frame.setOutlineColor( sf::Color::White );
+	frame.setOutlineThickness( 1.0f );
+
+	bar.setPosition( position );
+	bar.setFillColor( sf::Color::White );
+
+	window->draw( frame );
+	window->draw( bar );
+}
+
+void LoadingState::handleInput()
+{
+	sf::Event event;
+
+	while( mParent->mWindow->pollEvent( event ) )
+	{
+		if( event.type == sf::Event::Closed ) 
+		{
+			mParent->mWindow->close();
+		}
+	}
+}
+
 NozokiState::NozokiState( Game *parent ) : GameState( parent )
 {
+	mMap	   = &mDungeon;
+	mSeed	   = std::chrono::system_clock::now().time_since_epoch().count();
+	mCached	   = false;
+	mStreaming = false;
+	mRecording = false;
+	mReplaying = false;
+	mHeadless  = false;
+	mLiveInput = 0;
+	mTogglePause = false;
+
+	mThreadCount  = 0;
+	mActiveRadius = 32;
 }
 
+//Play a known dungeon, the first time it's generated and after that it's mapped straight from the cache
+void NozokiState::setSeed( unsigned int seed )
+{
+	mSeed	= seed;
+	mCached = true;
+}
+
+//Play a recorded session instead of reading the keyboard, in the dungeon it was recorded in
+bool NozokiState::setReplay( const std::string& path )
+{
+	if( !mInputLog.load( path ) )
+	{
+		return false;
+	}
+
+	mReplaying    = true;
+	mRecording    = false;
+	mStreaming    = mInputLog.isStreaming();
+	mActiveRadius = mInputLog.getActiveRadius();
+	setSeed( mInputLog.getSeed() );
+
+	return true;
+}
+
+//A fingerprint of where every entity is, a replay that ends up anywhere else has diverged
+sf::Uint64 NozokiState::getChecksum()
+{
+	sf::Uint64 hash = 14695981039346656037ULL;
+	size_t i, j;
+
+	for( i = 0; i < mEntities.size(); i++ )
+	{
+		const sf::Uint8 *bytes = (const sf::Uint8 *)&mEntities.mPosition[i];
+
+		for( j = 0; j < sizeof( sf::Vector2f ); j++ )
+		{
+			hash = ( hash ^ bytes[j] ) * 1099511628211ULL;
+		}
+	}
+
+	return hash;
+}
+
+void NozokiState::getAssets( std::vector<std::string>& paths )
+{
+	paths.push_back( "res/basictiles.png" );
+}
+
+//Builds the level, this runs on a loading thread so nothing in here can touch the window or a texture
+void NozokiState::load()
+{
+	PROFILE_ZONE( "load_level" );
+	sf::Clock clock;
+	bool	  cached = false;
+
+	//An unbounded dungeon only keeps the chunks around the player, generated as it goes
+	if( mStreaming )
+	{
+		mStreamedDungeon.generate( mSeed );
+		mMap = &mStreamedDungeon;
+	}
+	else if( mCached )
+	{
+		cached = mDungeon.load( mSeed, "cache" );
+	}
+	else
+	{
+		mDungeon.generate( mSeed );
+	}
+
+	std::cout << "Dungeon " << mSeed << ( cached ? " loaded from cache" : " generated" ) << " in "
+		  << clock.getElapsedTime().asMicroseconds() / 1000.0f << "ms" << std::endl;
+
+	mSpatial.resize( *mMap );
+	mFlowField.resize( *mMap );
+	mVisibility.resize( *mMap );
+	mMapRenderer.setTileRect( TILE_FLOOR, mMap->getTileRect( TILE_FLOOR ) );
+	mMapRenderer.setTileRect( TILE_ENEMY_SPAWN, mMap->getTileRect( TILE_ENEMY_SPAWN ) );
+	mMapRenderer.setTileRect( TILE_PLAYER_SPAWN, mMap->getTileRect( TILE_PLAYER_SPAWN ) );
+
+	//Drawing gets a copy of the map of its own, so the simulation can change tiles while it's being drawn
+	mRenderMap.reset( new Map( mMap->getWidth(), mMap->getHeight(), mMap->getTileSize() ) );
+	mRenderMap->setTiles( 0, 0, mMap->getWidth(), mMap->getHeight(), mMap->getRow( 0 ) );
+	mMapRenderer.build( *mRenderMap );
+	mRenderMap->clearDirty();
+	mMap->clearDirty();
+	mMapEdits.clear();
+}
+
+//Runs once the level is loaded and the textures are uploaded
 void NozokiState::initState()
 {
-	mPlayer.loadResources();
-	mPlayer.setPosition( mMap.getPlayerSpawn() );
-	spawnEnemies();
-	mView.reset( sf::FloatRect( 0, 0, 800, 600 ) );
+	mJobs.resize( mThreadCount );
+	mClock.reset();
+	mClock.setStep( getTimeStep() );
+	mTimers.reset( 0 );
+
+	//A recording starts over with every level
+	if( mRecording )
+	{
+		mInputLog.reset( mSeed, mParent->getSimulationRate(), mStreaming, mActiveRadius );
+	}
+
+	mEntities.setIndex( &mSpatial );
+	mEntities.clear();
+	mEntities.reserve( ENTITY_RESERVE );
+	mPlayer.spawn( mEntities, mMap->getPlayerSpawn() );
+	spawnLevelEnemies();
+	mLod.setRadius( mActiveRadius * mMap->getTileSize() );
+	mLod.setRooms( &mMap->getRooms(), mMap->getTileSize() );
+	mLod.reset( mEntities );
+
+	//A replay without a window has no context to upload textures to and nothing to draw sprites with
+	if( !mHeadless )
+	{
+		mPlayer.loadResources();
+		Slime::loadResources();
+		mMapRenderer.setTexture( gResources.getTexture( "res/basictiles.png" ) );
+		gResources.printStats();
+	}
+
+	mViewSize = sf::Vector2f( 800, 600 );
+	mView.reset( sf::FloatRect( sf::Vector2f( 0, 0 ), mViewSize ) );
 	mView.zoom( 1.0f );
+
+	//So there's something to draw before the first step
+	mFrameClock.restart();
+	publish();
 }
 
-//Called by the game object every frame
-void NozokiState::doFrame()
+//Called by the game object once per simulation step
+void NozokiState::update()
 {
-	//Set our view
-	mParent->mWindow->setView( mView );
-	
-	//Set the map's position
-	mMap.getSprite().setPosition( sf::Vector2f( 0.0f, mMap.getTileSize() ) );
-	
-	//Draw it
-	mParent->mWindow->draw( mMap.getSprite() );
+	PROFILE_ZONE( "update" );
+
+	if( mTogglePause.exchange( false ) )
+	{
+		mClock.setPaused( !mClock.isPaused() );
+	}
+
+	mEntities.storePositions();
+
+	//Nothing moves and no timers run down while paused
+	if( mClock.isPaused() )
+	{
+		return;
+	}
+
+	if( mStreaming )
+	{
+		streamChunks();
+	}
+
+	//Live input is whatever was held down as of the last frame, a recording keeps it and a replay reads it back instead
+	InputState input = mReplaying ? mInputLog.get( mClock.getTick() ) : mLiveInput.load();
+
+	if( mRecording )
+	{
+		mInputLog.push( input );
+	}
+
+	//Let the player decide where it wants to go
+	mPlayer.update( this, input );
+
+	size_t	     id	    = mPlayer.getId( mEntities );
+	sf::Vector2f player = mEntities.mPosition[id] + ( mEntities.mSize[id] / 2.0f );
+
+	applyMapChanges();
+
+	//Both only recompute when the player has moved to another tile
+	mFlowField.update( *mMap, mMap->getTileCoordForPoint( player ) );
+	mVisibility.update( *mMap, mMap->getTileCoordForPoint( player ) );
+
+	//Slimes the player can see can see the player, and give chase
+	mQueryResults.clear();
+	mSpatial.queryRadius( player, mVisibility.getRadius() * mMap->getTileSize(), mQueryResults );
+	Slime::notice( mEntities, mQueryResults, mVisibility, mMap->getTileSize() );
+
+	//Only what's near the player gets simulated this step
+	mLod.update( mEntities, mSpatial, mTimers, player, mClock.getTick(), mDue );
+
+	//Everything the AI can see while it runs, none of which changes until it's done
+	WorldSnapshot world;
+
+	world.map	= mMap;
+	world.flowField = &mFlowField;
+	world.player	= player;
+	world.step	= mClock.getStep();
+	world.tileSize	= mMap->getTileSize();
+	world.seed	= mSeed;
+	world.tick	= mClock.getTick();
 
-	//Update and draw all the other entities
-	for( auto it = mEntities.begin(); it != mEntities.end(); it++ )
+	//Slimes whose timers ran out this step pick what to do next
+	Slime::wake( world, mEntities, mTimers, mExpired );
+
+	//Then the AI decides where everything else that's due wants to go and it all moves, a range of them per job.
+	//Entities only write to themselves and their range's list, so the result is the same however the ranges are split up
+	mRescheduled.resize( ( mDue.size() + ENTITY_GRAIN - 1 ) / ENTITY_GRAIN );
+
+	mJobs.parallelFor( mDue.size(), ENTITY_GRAIN, [this, &world]( size_t first, size_t last )
+	{
+		PROFILE_ZONE( "update_entities" );
+		Slime::update( world, mEntities, &mDue[first], last - first, mRescheduled[first / ENTITY_GRAIN] );
+		mEntities.integrate( *world.map, world.step, &mDue[first], last - first );
+	} );
+
+	//Timers moved during the update go back on the wheel in the order their slimes were updated
+	for( auto list = mRescheduled.begin(); list != mRescheduled.end(); list++ )
 	{
-		( *it )->update( this );
-		mParent->mWindow->draw( ( *it )->getSprite() );
+		for( auto it = list->begin(); it != list->end(); it++ )
+		{
+			mTimers.schedule( mEntities.getHandle( *it ), mEntities.mDeadline[*it] );
+		}
+
+		list->clear();
 	}
 
-	//Then the player
-	mPlayer.update( this );
+	mEntities.updateIndex( mDue.data(), mDue.size() );
+	mClock.advance();
+}
+
+static sf::Vector2f interpolate( sf::Vector2f from, sf::Vector2f to, float alpha )
+{
+	return from + ( ( to - from ) * alpha );
+}
+
+//Runs on the simulation thread after it has caught up. Fills in the snapshot drawing will pick up next,
+//with every sprite in or close to the view as of the last step, player last so it ends up on top
+void NozokiState::publish()
+{
+	if( mHeadless )
+	{
+		return;
+	}
+
+	FrameSnapshot&	frame	 = mSnapshots.getBack();
+	size_t		id	 = mPlayer.getId( mEntities );
+	float		tileSize = mMap->getTileSize();
+
+	frame.cameraPrevious = mEntities.mPrevPosition[id];
+	frame.camera	     = mEntities.mPosition[id];
+	frame.stepped	     = mFrameClock.getElapsedTime();
+	frame.step	     = sf::seconds( getTimeStep() );
+	frame.sprites.clear();
+
+	//Anything up to a tile outside the view could be moving into it, in id order so overlapping sprites don't flicker
+	sf::FloatRect view( frame.camera - ( mViewSize / 2.0f ) - sf::Vector2f( tileSize, tileSize ),
+			    mViewSize + sf::Vector2f( tileSize * 2, tileSize * 2 ) );
+
+	mQueryResults.clear();
+	mSpatial.queryAABB( view, mQueryResults );
+	std::sort( mQueryResults.begin(), mQueryResults.end() );
+
+	for( auto it = mQueryResults.begin(); it != mQueryResults.end(); it++ )
+	{
+		if( mEntities.mKind[*it] == ENTITY_SLIME )
+		{
+			FrameSnapshot::Sprite sprite;
+
+			sprite.sprite	= Slime::getSprite( mEntities, *it, mClock.getTime() );
+			sprite.previous = mEntities.mPrevPosition[*it];
+			sprite.current	= mEntities.mPosition[*it];
+			frame.sprites.push_back( sprite );
+		}
+	}
+
+	FrameSnapshot::Sprite player;
+
+	player.sprite	= mPlayer.getSprite( mEntities, mClock.getTime() );
+	player.previous = frame.cameraPrevious;
+	player.current	= frame.camera;
+	frame.sprites.push_back( player );
+
+	mSnapshots.publish();
+}
+
+//Called by the game object every frame. The simulation runs on its own, so there's no alpha passed in,
+//the snapshot says when its step was, which is what says how far to go between that step and the one before
+void NozokiState::draw( float )
+{
+	applyMapEdits();
+	mSnapshots.acquire();
+
+	const FrameSnapshot& frame = mSnapshots.getFront();
+	float		     alpha = std::min( 1.0f, ( mFrameClock.getElapsedTime() - frame.stepped ) / frame.step );
 
 	//Center the camera on the player
-	mView.setCenter( mPlayer.getPosition() );
+	mView.setCenter( interpolate( frame.cameraPrevious, frame.camera, alpha ) );
 
-	//Re-set the view of our window to the updated one
+	//Set the updated view on our window
 	mParent->mWindow->setView( mView );
 
-	//And draw the player to it
-	mParent->mWindow->draw( mPlayer.getSprite() );
+	//Draw the chunks of the map that are in view
+	{
+		PROFILE_ZONE( "draw_map" );
+		mParent->mWindow->draw( mMapRenderer );
+	}
+
+	PROFILE_ZONE( "draw_entities" );
+
+	//Batch up every sprite that's on screen
+	mSpriteBatch.clear();
+	mSpriteBatch.setCullRect( getViewRect( mView ) );
+
+	for( auto it = frame.sprites.begin(); it != frame.sprites.end(); it++ )
+	{
+		sf::Sprite sprite = it->sprite;
+		sprite.setPosition( interpolate( it->previous, it->current, alpha ) );
+		mSpriteBatch.add( sprite );
+	}
+
+	//And draw them all at once
+	mParent->mWindow->draw( mSpriteBatch );
+
+	PROFILE_COUNT( "draw_calls", mMapRenderer.getChunksDrawn() + mSpriteBatch.getDrawCalls() );
 }
 
 void NozokiState::handleInput()
 {
+	PROFILE_ZONE( "handle_input" );
 	sf::Event event;
 
 	while( mParent->mWindow->pollEvent( event ) )
@@ -142,27 +815,159 @@ void NozokiState::handleInput()
 		{
 			mParent->mWindow->close();
 		}
-	
-		mPlayer.handleEvent( event );
-		for( auto it = mEntities.begin(); it != mEntities.end(); it++ )
+
+		//F3 shows where the frame time goes, F4 saves the last few seconds of it for a trace viewer
+		if( event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3 )
+		{
+			mParent->toggleProfile();
+		}
+
+		//The simulation thread picks this up at its next step
+		if( event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::P )
+		{
+			mTogglePause = true;
+		}
+
+		if( event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F4 )
 		{
-			( *it )->handleEvent( event );
+			mParent->saveTrace();
 		}
 	}
+
+	//Polled here since the simulation thread shouldn't go near the window
+	mLiveInput = readKeyboard();
 }
 
-void NozokiState::spawnEnemies()
+//Put a slime on every enemy spawn in an area of the map, in tiles
+void NozokiState::spawnEnemies( sf::IntRect area )
 {
 	int i, j;
 
-	for( i = 0; i < mMap.getWidth(); i++ )
+	for( j = area.top; j < area.top + area.height; j++ )
 	{
-		for( j = 0; j < mMap.getHeight(); j++ )
+		for( i = area.left; i < area.left + area.width; i++ )
 		{
-			if( mMap.getTile( i, j ) == TILE_ENEMY_SPAWN )
+			if( mMap->getTile( i, j ) == TILE_ENEMY_SPAWN )
 			{
-				mEntities.push_back( new Slime( mMap.getCoordForTile( i, j ) ) );
+				Slime::spawn( mEntities, mMap->getCoordForTile( i, j ), mTimers, mClock );
 			}
 		}
 	}
 }
+
+//Every enemy in the level. One mapped from its file has them listed already, in the same order looking
+//through the tiles would find them, so there's no need to look through the tiles
+void NozokiState::spawnLevelEnemies()
+{
+	const LevelFile *level = mMap->getLevel();
+	size_t		 i;
+
+	if( level == NULL )
+	{
+		spawnEnemies( sf::IntRect( 0, 0, mMap->getWidth(), mMap->getHeight() ) );
+		return;
+	}
+
+	for( i = 0; i < level->getHeader().enemyCount; i++ )
+	{
+		const LevelSpawn& spawn = level->getEnemySpawns()[i];
+
+		Slime::spawn( mEntities, mMap->getCoordForTile( spawn.x, spawn.y ), mTimers, mClock );
+	}
+}
+
+//Tiles changed since the last step, like a door opening or a wall breaking, are sent over to drawing's copy
+//of the map, and anything worked out from the old tiles is redone
+void NozokiState::applyMapChanges()
+{
+	const std::vector<sf::IntRect>& dirty = mMap->getDirtyRects();
+
+	if( dirty.empty() )
+	{
+		return;
+	}
+
+	PROFILE_ZONE( "map_changes" );
+	mFlowField.invalidate();
+	mVisibility.invalidate();
+
+	if( !mHeadless )
+	{
+		std::lock_guard<std::mutex> lock( mEditMutex );
+
+		for( auto it = dirty.begin(); it != dirty.end(); it++ )
+		{
+			mMapEdits.push_back( MapEdit() );
+			mMapEdits.back().area = *it;
+			mMapEdits.back().tiles.resize( it->width * it->height );
+			mMap->getTiles( it->left, it->top, it->width, it->height, &mMapEdits.back().tiles[0] );
+		}
+	}
+
+	mMap->clearDirty();
+}
+
+//Drawing side, copy the edits the simulation has sent since last frame into our map and patch just those
+//tiles in the renderer's chunks. If one of them was the whole map, like when the streamed dungeon slides,
+//the chunks are built over again
+void NozokiState::applyMapEdits()
+{
+	bool rebuild = false;
+
+	{
+		std::lock_guard<std::mutex> lock( mEditMutex );
+		mReceivedEdits.swap( mMapEdits );
+	}
+
+	if( mReceivedEdits.empty() )
+	{
+		return;
+	}
+
+	for( auto it = mReceivedEdits.begin(); it != mReceivedEdits.end(); it++ )
+	{
+		mRenderMap->setTiles( it->area.left, it->area.top, it->area.width, it->area.height, &it->tiles[0] );
+		rebuild |= it->area == sf::IntRect( 0, 0, mRenderMap->getWidth(), mRenderMap->getHeight() );
+	}
+
+	if( rebuild )
+	{
+		mMapRenderer.build( *mRenderMap );
+	}
+	else
+	{
+		mMapRenderer.update( *mRenderMap );
+	}
+
+	mRenderMap->clearDirty();
+	mReceivedEdits.clear();
+}
+
+//Keep the streamed dungeon's window around the player. When it slides everything in it moves back
+//by the same amount, so nothing can tell, and the chunks that just came into it get their slimes
+void NozokiState::streamChunks()
+{
+	PROFILE_ZONE( "stream_chunks" );
+	size_t id = mPlayer.getId( mEntities );
+	sf::Vector2i shift = mStreamedDungeon.update( mEntities.mPosition[id] + ( mEntities.mSize[id] / 2.0f ), mEntities.mVelocity[id] );
+
+	if( shift == sf::Vector2i( 0, 0 ) )
+	{
+		return;
+	}
+
+	float tileSize = mMap->getTileSize();
+
+	//The tiles that were copied in are sent over to drawing along with any other changes this step
+	mEntities.translate( sf::Vector2f( -shift.x * tileSize, -shift.y * tileSize ), mMap->getAABB() );
+
+	const std::vector<sf::IntRect>& fresh = mStreamedDungeon.getFreshAreas();
+
+	for( auto it = fresh.begin(); it != fresh.end(); it++ )
+	{
+		spawnEnemies( *it );
+	}
+
+	//Ids moved around when the slimes left behind were destroyed
+	mLod.reset( mEntities );
+}
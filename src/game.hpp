@@ -35,32 +35,150 @@ class GameState
 public:
 	GameState( Game * );
 
-	int getDelta();
+	float getTimeStep();
+	virtual void getAssets( std::vector<std::string>& ) {}
+	virtual void load() {}
 	virtual void handleInput() {}
 	virtual void initState() {}
-	virtual void doFrame() {}
+	virtual void update() {}
+	virtual void draw( float ) {}
+	virtual bool isThreaded() { return false; }
+	virtual void publish() {}
 
 protected:
 	Game *mParent;
 };
 
-//State used for our actual game
+//Everything drawing needs from the simulation's last step, so it never has to look at the simulation itself.
+//Sprites come with where they were the step before, to draw them somewhere in between
+struct FrameSnapshot
+{
+	struct Sprite
+	{
+		sf::Sprite	sprite;
+		sf::Vector2f	previous;
+		sf::Vector2f	current;
+	};
+
+	std::vector<Sprite>	sprites;
+	sf::Vector2f		cameraPrevious;
+	sf::Vector2f		camera;
+	sf::Time		stepped;
+	sf::Time		step;
+};
+
+//State used for our actual game. Its simulation runs on a thread of its own, and drawing works from
+//the snapshots it publishes and its own copy of the map, which changed tiles are sent over to
 class NozokiState : public GameState
 {
 public:
 	NozokiState( Game * );
+	virtual void getAssets( std::vector<std::string>& );
+	virtual void load();
 	virtual void handleInput();
 	virtual void initState();
-	virtual void doFrame();
-	DungeonMap& getMap() { return mMap; }
-	void spawnEnemies();
+	virtual void update();
+	virtual void draw( float );
+	virtual bool isThreaded() { return true; }
+	virtual void publish();
+	void setStreaming( bool streaming ) { mStreaming = streaming; }
+	void setSeed( unsigned int );
+	void setThreadCount( size_t threads ) { mThreadCount = threads; }
+	void setActiveRadius( unsigned int tiles ) { mActiveRadius = tiles; }
+	void setRecording( bool recording ) { mRecording = recording; }
+	void setHeadless( bool headless ) { mHeadless = headless; }
+	bool setReplay( const std::string& );
+	InputLog& getInputLog() { return mInputLog; }
+	sf::Uint64 getChecksum();
+	DungeonMap& getMap() { return *mMap; }
+	EntityStore& getEntities() { return mEntities; }
+	Player& getPlayer() { return mPlayer; }
+	SpatialHash& getSpatial() { return mSpatial; }
+	FlowField& getFlowField() { return mFlowField; }
+	Visibility& getVisibility() { return mVisibility; }
+	JobPool& getJobs() { return mJobs; }
+	void spawnEnemies( sf::IntRect );
+	void spawnLevelEnemies();
 
 private:
-	std::vector<Entity*>	mEntities;
+	//Tiles that changed in the simulation's map, on their way to drawing's copy
+	struct MapEdit
+	{
+		sf::IntRect		area;
+		std::vector<sf::Uint8>	tiles;
+	};
+
+	void streamChunks();
+	void applyMapChanges();
+	void applyMapEdits();
+
+	EntityStore		mEntities;
 	Player			mPlayer;
 	sf::View		mView;
-	DungeonMap		mMap;
+	DungeonMap		mDungeon;
+	StreamedDungeon		mStreamedDungeon;
+	DungeonMap		*mMap;
+	unsigned int		mSeed;
+	GameClock		mClock;
+	TimerWheel		mTimers;
+	std::vector<size_t>	mExpired;
+	std::vector<std::vector<size_t>>	mRescheduled;
+	SimulationLod		mLod;
+	unsigned int		mActiveRadius;
+	std::vector<size_t>	mDue;
+	bool			mCached;
+	bool			mStreaming;
+	MapRenderer		mMapRenderer;
+	SpriteBatch		mSpriteBatch;
+	SpatialHash		mSpatial;
+	FlowField		mFlowField;
+	Visibility		mVisibility;
+	JobPool			mJobs;
+	size_t			mThreadCount;
+	std::vector<size_t>	mQueryResults;
+	InputLog		mInputLog;
+	bool			mRecording;
+	bool			mReplaying;
+	bool			mHeadless;
+	std::atomic<InputState>	mLiveInput;
+	std::atomic<bool>	mTogglePause;
+	sf::Vector2f		mViewSize;
+	sf::Clock		mFrameClock;
+	TripleBuffer<FrameSnapshot>	mSnapshots;
+	std::unique_ptr<Map>	mRenderMap;
+	std::vector<MapEdit>	mMapEdits;
+	std::vector<MapEdit>	mReceivedEdits;
+	std::mutex		mEditMutex;
+};
+
+//Shown while another state's level is built and its textures are decoded on worker threads.
+//Only uploading the decoded images happens here on the main thread, then it hands over to that state
+class LoadingState : public GameState
+{
+public:
+	LoadingState( Game * );
+	~LoadingState();
+	void setNext( GameState *next ) { mNext = next; }
+	virtual void handleInput();
+	virtual void initState();
+	virtual void update();
+	virtual void draw( float );
+	float getProgress();
 
+private:
+	void decodeAssets();
+	void join();
+
+	GameState			*mNext;
+	std::vector<std::string>	 mPaths;
+	std::vector<sf::Image>		 mImages;
+	std::vector<size_t>		 mDecoded;
+	std::vector<std::thread>	 mWorkers;
+	std::mutex			 mMutex;
+	std::atomic<size_t>		 mNextAsset;
+	std::atomic<bool>		 mLoaded;
+	size_t				 mUploaded;
+	sf::Clock			 mClock;
 };
 
 //The game itself
@@ -70,7 +188,17 @@ public:
 	Game();
 	void doLoop();
 	void setState( GameState *);
-	int getDelta() { return mFrameTime; }
+	void setSimulationRate( unsigned int );
+	void setStreaming( bool streaming ) { mNozState.setStreaming( streaming ); }
+	void setSeed( unsigned int seed ) { mNozState.setSeed( seed ); }
+	void setThreadCount( size_t threads ) { mNozState.setThreadCount( threads ); }
+	void setActiveRadius( unsigned int tiles ) { mNozState.setActiveRadius( tiles ); }
+	void setRecording( const std::string& );
+	int replay( const std::string&, const std::string& );
+	float getTimeStep() { return mTimeStep.asSeconds(); }
+	unsigned int getSimulationRate() { return 1000000 / mTimeStep.asMicroseconds(); }
+	void toggleProfile();
+	void saveTrace();
 
 	sf::RenderWindow	*mWindow;
 
@@ -78,11 +206,22 @@ private:
 	int		 mWindowWidth;
 	int		 mWindowHeight;
 	sf::Clock	 mDeltaClock;
-	int		 mFrameTime;
+	sf::Time	 mFrameTime;
+	sf::Time	 mTimeStep;
+	sf::Time	 mAccumulator;
+	sf::Time	 mMaxFrameTime;
 	GameState	*mState;
 	NozokiState	 mNozState;
+	LoadingState	 mLoadingState;
+	ProfileOverlay	 mProfileOverlay;
+	bool		 mShowProfile;
+	std::string	 mRecordPath;
+	std::thread	 mSimulation;
+	std::atomic<bool>	 mSimulating;
 
 	void openWindow();	
+	void simulate();
+	void stopSimulation();
 };
 
 #endif
@@ -0,0 +1,211 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+#include <SFML/Graphics.hpp>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#include "random.hpp"
+#include "map.hpp"
+
+//What came out of generating one seed
+struct GenResult
+{
+	unsigned int	seed;
+	size_t		rooms;
+	size_t		enemies;
+	double		coverage;
+	double		millis;
+};
+
+//Seeds are handed out to the workers in chunks of this many
+static const unsigned int CHUNK_SIZE = 16;
+
+//Generate seeds until there are none left, every worker owns its map so nothing is shared but the counter
+static void generateSeeds( unsigned int start, unsigned int count, std::atomic<unsigned int> *next, std::vector<GenResult> *results )
+{
+	Map		map( 512, 512, 16 );
+	unsigned int	i;
+
+	for( ;; )
+	{
+		unsigned int first = next->fetch_add( CHUNK_SIZE );
+		if( first >= count )
+		{
+			break;
+		}
+
+		unsigned int last = std::min( first + CHUNK_SIZE, count );
+
+		for( i = first; i < last; i++ )
+		{
+			GenResult& r = (*results)[i];
+			auto begin = std::chrono::steady_clock::now();
+
+			DungeonGenerator generator( start + i );
+			map.clear();
+			generator.generate( map );
+
+			auto end = std::chrono::steady_clock::now();
+
+			r.seed     = start + i;
+			r.rooms    = generator.getRoomCount();
+			r.enemies  = generator.getEnemyCount();
+			r.coverage = (double)map.countWalkable() / ( map.getWidth() * map.getHeight() );
+			r.millis   = std::chrono::duration<double, std::milli>( end - begin ).count();
+		}
+	}
+}
+
+static void writeResults( const std::vector<GenResult>& results, const std::string& path )
+{
+	std::ofstream out( path );
+
+	if( !out )
+	{
+		std::cout << "Error opening " << path << " for writing!" << std::endl;
+		return;
+	}
+
+	out << "seed,rooms,enemies,coverage,millis\n";
+
+	for( auto it = results.begin(); it != results.end(); it++ )
+	{
+		out << it->seed << "," << it->rooms << "," << it->enemies << ","
+		    << std::setprecision( 5 ) << it->coverage << "," << it->millis << "\n";
+	}
+}
+
+static void printSummary( const std::vector<GenResult>& results, unsigned int threads, double seconds )
+{
+	size_t rooms = 0, enemies = 0, fewestRooms = results[0].rooms;
+	double coverage = 0.0, slowest = 0.0;
+
+	for( auto it = results.begin(); it != results.end(); it++ )
+	{
+		rooms	    += it->rooms;
+		enemies	    += it->enemies;
+		coverage    += it->coverage;
+		fewestRooms  = std::min( fewestRooms, it->rooms );
+		slowest	     = std::max( slowest, it->millis );
+	}
+
+	double n = results.size();
+
+	std::cout << std::fixed << std::setprecision( 2 )
+		  << results.size() << " dungeons on " << threads << " threads in " << seconds << "s ("
+		  << n / seconds << " per second)\n"
+		  << "rooms: " << rooms / n << " average, " << fewestRooms << " fewest\n"
+		  << "enemies: " << enemies / n << " average\n"
+		  << "floor coverage: " << 100.0 * coverage / n << "% average\n"
+		  << "slowest dungeon: " << slowest << "ms" << std::endl;
+}
+
+static void printUsage( const char *name )
+{
+	std::cout << "Usage: " << name << " [--start <seed>] [--seeds <count>] [--threads <count>] [--out <file>]" << std::endl;
+}
+
+int main( int argc, char **argv )
+{
+	unsigned int	start = 0, seeds = 1000, threads = std::thread::hardware_concurrency();
+	std::string	out = "dungeons.csv";
+	int		i;
+
+	for( i = 1; i < argc; i++ )
+	{
+		//Every option takes a value
+		if( i + 1 >= argc )
+		{
+			printUsage( argv[0] );
+			return 1;
+		}
+
+		if( std::strcmp( argv[i], "--start" ) == 0 )
+		{
+			start = std::strtoul( argv[++i], NULL, 10 );
+		}
+		else if( std::strcmp( argv[i], "--seeds" ) == 0 )
+		{
+			seeds = std::strtoul( argv[++i], NULL, 10 );
+		}
+		else if( std::strcmp( argv[i], "--threads" ) == 0 )
+		{
+			threads = std::strtoul( argv[++i], NULL, 10 );
+		}
+		else if( std::strcmp( argv[i], "--out" ) == 0 )
+		{
+			out = argv[++i];
+		}
+		else
+		{
+			printUsage( argv[0] );
+			return 1;
+		}
+	}
+
+	if( seeds == 0 )
+	{
+		return 0;
+	}
+
+	if( threads == 0 )
+	{
+		threads = 1;
+	}
+
+	std::vector<GenResult> results( seeds );
+	std::vector<std::thread> workers;
+	std::atomic<unsigned int> next( 0 );
+	auto begin = std::chrono::steady_clock::now();
+
+	for( i = 0; i < (int)threads; i++ )
+	{
+		workers.push_back( std::thread( generateSeeds, start, seeds, &next, &results ) );
+	}
+
+	for( auto it = workers.begin(); it != workers.end(); it++ )
+	{
+		it->join();
+	}
+
+	double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+
+	writeResults( results, out );
+	printSummary( results, threads, seconds );
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/System.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include "input.hpp"
+
+//A run is its input in the top byte and how many steps it lasted in the rest
+static const sf::Uint32 RUN_BITS   = 24;
+static const sf::Uint32 RUN_LENGTH = ( 1 << RUN_BITS ) - 1;
+
+InputState readKeyboard()
+{
+	InputState input = 0;
+
+	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Up ) )
+	{
+		input |= INPUT_UP;
+	}
+
+	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Down ) )
+	{
+		input |= INPUT_DOWN;
+	}
+
+	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Left ) )
+	{
+		input |= INPUT_LEFT;
+	}
+
+	if( sf::Keyboard::isKeyPressed( sf::Keyboard::Right ) )
+	{
+		input |= INPUT_RIGHT;
+	}
+
+	return input;
+}
+
+InputLog::InputLog()
+{
+	reset( 0, 60, false, 0 );
+}
+
+//Start a new session, throwing away any input already logged. The active radius is kept since
+//a different one simulates different slimes, logs from before there was one have 0, everything active
+void InputLog::reset( unsigned int seed, unsigned int tickRate, bool streaming, unsigned int activeRadius )
+{
+	mRuns.clear();
+	mRunStarts.clear();
+	mSeed	      = seed;
+	mTickRate     = tickRate;
+	mStreaming    = streaming;
+	mActiveRadius = activeRadius;
+	mTickCount = 0;
+	mChecksum  = 0;
+}
+
+//Add the next step's input, which only costs anything when it differs from the last
+void InputLog::push( InputState input )
+{
+	if( !mRuns.empty() && ( mRuns.back() >> RUN_BITS ) == input && ( mRuns.back() & RUN_LENGTH ) < RUN_LENGTH )
+	{
+		mRuns.back()++;
+	}
+	else
+	{
+		mRuns.push_back( ( (sf::Uint32)input << RUN_BITS ) | 1 );
+		mRunStarts.push_back( mTickCount );
+	}
+
+	mTickCount++;
+}
+
+//The input for a step, nothing held once the log runs out
+InputState InputLog::get( size_t tick ) const
+{
+	if( tick >= mTickCount )
+	{
+		return 0;
+	}
+
+	size_t run = std::upper_bound( mRunStarts.begin(), mRunStarts.end(), tick ) - mRunStarts.begin() - 1;
+
+	return mRuns[run] >> RUN_BITS;
+}
+
+bool InputLog::save( const std::string& path ) const
+{
+	std::ofstream	out( path.c_str(), std::ios::binary );
+	InputLogHeader	h;
+
+	if( !out )
+	{
+		std::cout << "Error opening " << path << " for writing!" << std::endl;
+		return false;
+	}
+
+	std::memset( &h, 0, sizeof( h ) );
+	std::memcpy( h.magic, "NZIN", 4 );
+	h.version      = VERSION;
+	h.seed	       = mSeed;
+	h.tickRate     = mTickRate;
+	h.flags	       = mStreaming ? INPUT_LOG_STREAMING : 0;
+	h.tickCount    = mTickCount;
+	h.runCount     = mRuns.size();
+	h.activeRadius = mActiveRadius;
+	h.checksum     = mChecksum;
+
+	out.write( (const char *)&h, sizeof( h ) );
+
+	if( !mRuns.empty() )
+	{
+		out.write( (const char *)&mRuns[0], mRuns.size() * sizeof( sf::Uint32 ) );
+	}
+
+	return (bool)out;
+}
+
+bool InputLog::load( const std::string& path )
+{
+	std::ifstream	in( path.c_str(), std::ios::binary );
+	InputLogHeader	h;
+	size_t		i;
+
+	if( !in || !in.read( (char *)&h, sizeof( h ) ) || std::memcmp( h.magic, "NZIN", 4 ) != 0 || h.version != VERSION ||
+	    h.tickRate == 0 )
+	{
+		std::cout << "Error loading input log from " << path << "!" << std::endl;
+		return false;
+	}
+
+	reset( h.seed, h.tickRate, ( h.flags & INPUT_LOG_STREAMING ) != 0, h.activeRadius );
+	mRuns.resize( h.runCount );
+
+	if( h.runCount > 0 && !in.read( (char *)&mRuns[0], h.runCount * sizeof( sf::Uint32 ) ) )
+	{
+		std::cout << "Input log " << path << " is truncated!" << std::endl;
+		reset( 0, 60, false, 0 );
+		return false;
+	}
+
+	//Rebuild where each run starts so a step's input can be found with a binary search
+	for( i = 0; i < mRuns.size(); i++ )
+	{
+		mRunStarts.push_back( mTickCount );
+		mTickCount += mRuns[i] & RUN_LENGTH;
+	}
+
+	mChecksum = h.checksum;
+
+	return true;
+}
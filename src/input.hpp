@@ -0,0 +1,93 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+//Everything the player can be holding down during a step, one bit per button
+enum {
+	INPUT_UP    = 1 << 0,
+	INPUT_DOWN  = 1 << 1,
+	INPUT_LEFT  = 1 << 2,
+	INPUT_RIGHT = 1 << 3
+};
+
+typedef sf::Uint8 InputState;
+
+//Poll the keyboard for the buttons held down right now
+InputState readKeyboard();
+
+//Start of every input log file, the runs follow it
+struct InputLogHeader
+{
+	char		magic[4];
+	sf::Uint32	version;
+	sf::Uint32	seed;
+	sf::Uint32	tickRate;
+	sf::Uint32	flags;
+	sf::Uint32	tickCount;
+	sf::Uint32	runCount;
+	sf::Uint32	activeRadius;
+	sf::Uint64	checksum;
+};
+
+//Set in the header's flags for a session played in the unbounded dungeon
+static const sf::Uint32 INPUT_LOG_STREAMING = 1 << 0;
+
+//The input of every step of a session and what's needed to play it again: the dungeon's seed,
+//the step rate and a checksum of where everything ended up. Input is kept as runs of the same
+//state, an input and a count of steps packed into 32 bits, so a long session stays small
+class InputLog
+{
+public:
+	InputLog();
+	void		reset( unsigned int, unsigned int, bool, unsigned int );
+	void		push( InputState );
+	InputState	get( size_t ) const;
+	void		setChecksum( sf::Uint64 checksum ) { mChecksum = checksum; }
+	unsigned int	getSeed() const { return mSeed; }
+	unsigned int	getTickRate() const { return mTickRate; }
+	bool		isStreaming() const { return mStreaming; }
+	unsigned int	getActiveRadius() const { return mActiveRadius; }
+	size_t		getTickCount() const { return mTickCount; }
+	sf::Uint64	getChecksum() const { return mChecksum; }
+	bool		save( const std::string& ) const;
+	bool		load( const std::string& );
+
+	static const sf::Uint32	VERSION = 4;
+
+private:
+	std::vector<sf::Uint32>	mRuns;
+	std::vector<size_t>	mRunStarts;
+	unsigned int		mSeed;
+	unsigned int		mTickRate;
+	bool			mStreaming;
+	unsigned int		mActiveRadius;
+	size_t			mTickCount;
+	sf::Uint64		mChecksum;
+};
+
+#endif
@@ -0,0 +1,215 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+#include "jobs.hpp"
+
+JobPool::JobPool() : mRemaining( 0 ), mStealCount( 0 )
+{
+	mGeneration = 0;
+	mRunning    = false;
+
+	//The calling thread always takes part, so there's always a queue for it
+	mQueues.push_back( std::unique_ptr<Queue>( new Queue ) );
+}
+
+JobPool::~JobPool()
+{
+	stop();
+}
+
+//Run jobs on this many threads in total, counting the one calling parallelFor. 0 is one per core
+void JobPool::resize( size_t threads )
+{
+	size_t i;
+
+	stop();
+
+	if( threads == 0 )
+	{
+		threads = std::max( 1u, std::thread::hardware_concurrency() );
+	}
+
+	mRunning = true;
+	mQueues.clear();
+
+	for( i = 0; i < threads; i++ )
+	{
+		mQueues.push_back( std::unique_ptr<Queue>( new Queue ) );
+	}
+
+	for( i = 1; i < threads; i++ )
+	{
+		mWorkers.push_back( std::thread( &JobPool::run, this, i ) );
+	}
+}
+
+void JobPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		mRunning = false;
+		mWake.notify_all();
+	}
+
+	for( auto it = mWorkers.begin(); it != mWorkers.end(); it++ )
+	{
+		it->join();
+	}
+
+	mWorkers.clear();
+}
+
+//Call job over [0, count) in pieces of at most grain, spread over every thread, and return once it's all done.
+//Which thread runs which piece changes from call to call, so a job must only touch its own piece
+void JobPool::parallelFor( size_t count, size_t grain, const Job& job )
+{
+	size_t threads = mQueues.size();
+	size_t pieces  = ( count + grain - 1 ) / grain;
+	size_t i;
+
+	if( count == 0 )
+	{
+		return;
+	}
+
+	//Not worth waking anyone up for
+	if( pieces == 1 || threads == 1 )
+	{
+		job( 0, count );
+		return;
+	}
+
+	mRemaining = pieces;
+
+	//Deal each thread a contiguous run of pieces
+	for( i = 0; i < pieces; i++ )
+	{
+		Range range = { i * grain, std::min( count, ( i + 1 ) * grain ), &job };
+		Queue& queue = *mQueues[( i * threads ) / pieces];
+		std::lock_guard<std::mutex> lock( queue.mutex );
+
+		queue.ranges.push_back( range );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		mGeneration++;
+		mWake.notify_all();
+	}
+
+	while( runOne( 0 ) )
+	{
+	}
+
+	std::unique_lock<std::mutex> lock( mMutex );
+
+	mDone.wait( lock, [this]() { return mRemaining == 0; } );
+}
+
+//Run one piece, our own from the front if we have any or someone else's from the back if we don't
+bool JobPool::runOne( size_t self )
+{
+	size_t threads = mQueues.size();
+	size_t i;
+	Range  range;
+
+	for( i = 0; i < threads; i++ )
+	{
+		Queue& queue = *mQueues[( self + i ) % threads];
+		std::lock_guard<std::mutex> lock( queue.mutex );
+
+		if( queue.ranges.empty() )
+		{
+			continue;
+		}
+
+		if( i == 0 )
+		{
+			range = queue.ranges.front();
+			queue.ranges.pop_front();
+		}
+		else
+		{
+			range = queue.ranges.back();
+			queue.ranges.pop_back();
+			mStealCount++;
+		}
+		break;
+	}
+
+	if( i == threads )
+	{
+		return false;
+	}
+
+	( *range.job )( range.first, range.last );
+
+	if( --mRemaining == 0 )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mDone.notify_all();
+	}
+
+	return true;
+}
+
+//Worker, sleeps until there's a new batch and then works until there's nothing left to take
+void JobPool::run( size_t self )
+{
+	size_t seen = 0;
+
+	for( ;; )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+
+			mWake.wait( lock, [this, &seen]() { return !mRunning || mGeneration != seen; } );
+
+			if( !mRunning )
+			{
+				return;
+			}
+
+			seen = mGeneration;
+		}
+
+		while( runOne( self ) )
+		{
+		}
+	}
+}
@@ -0,0 +1,119 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef JOBS_HPP
+#define JOBS_HPP
+
+//A fixed set of worker threads that split a range of work between them. Each thread starts on the
+//pieces dealt to it and steals from the back of the others' once it runs out, so none of them sit idle
+class JobPool
+{
+public:
+	typedef std::function<void( size_t, size_t )> Job;
+
+	JobPool();
+	~JobPool();
+	void	resize( size_t );
+	void	parallelFor( size_t, size_t, const Job& );
+	size_t getThreadCount() { return mWorkers.size() + 1; }
+	size_t getStealCount() { return mStealCount; }
+
+private:
+	struct Range
+	{
+		size_t		 first;
+		size_t		 last;
+		const Job	*job;
+	};
+
+	struct Queue
+	{
+		std::mutex		mutex;
+		std::deque<Range>	ranges;
+	};
+
+	void	run( size_t );
+	bool	runOne( size_t );
+	void	stop();
+
+	std::vector<std::thread>		mWorkers;
+	std::vector<std::unique_ptr<Queue>>	mQueues;
+	std::mutex				mMutex;
+	std::condition_variable			mWake;
+	std::condition_variable			mDone;
+	std::atomic<size_t>			mRemaining;
+	std::atomic<size_t>			mStealCount;
+	size_t					mGeneration;
+	bool					mRunning;
+};
+
+//Hands the latest of something from one thread to another without either ever waiting. There are three
+//copies: one being written, one being read and one in the middle they swap with. Whatever the writer
+//publishes replaces the middle one, so if it's quicker than the reader the reader only sees the newest
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() : mMiddle( 1 )
+	{
+		mBack  = 0;
+		mFront = 2;
+	}
+
+	//Writer side, fill in the back copy and then publish it
+	T& getBack() { return mBuffers[mBack]; }
+
+	void publish()
+	{
+		mBack = mMiddle.exchange( mBack | FRESH, std::memory_order_acq_rel ) & INDEX;
+	}
+
+	//Reader side, swap in whatever was published since last time. Returns false if there's nothing
+	//newer, and the front copy stays what it was
+	bool acquire()
+	{
+		if( !( mMiddle.load( std::memory_order_relaxed ) & FRESH ) )
+		{
+			return false;
+		}
+
+		mFront = mMiddle.exchange( mFront, std::memory_order_acq_rel ) & INDEX;
+		return true;
+	}
+
+	const T& getFront() const { return mBuffers[mFront]; }
+
+private:
+	static const unsigned int INDEX = 3;
+	static const unsigned int FRESH = 4;
+
+	T				mBuffers[3];
+	unsigned int			mBack;
+	unsigned int			mFront;
+	std::atomic<unsigned int>	mMiddle;
+};
+
+#endif
@@ -0,0 +1,259 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+#include <SFML/Graphics.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "random.hpp"
+#include "map.hpp"
+#include "room.hpp"
+#include "level.hpp"
+
+static const char LEVEL_MAGIC[4] = { 'N', 'Z', 'L', 'V' };
+
+//Sections start on a cache line
+static sf::Uint64 alignOffset( sf::Uint64 offset )
+{
+	return ( offset + 63 ) & ~(sf::Uint64)63;
+}
+
+//Whether size bytes starting at offset are all inside a file of fileSize bytes
+static bool fitsInFile( sf::Uint64 offset, sf::Uint64 size, sf::Uint64 fileSize )
+{
+	return offset <= fileSize && size <= fileSize - offset;
+}
+
+LevelFile::LevelFile()
+{
+	mData	= NULL;
+	mSize	= 0;
+	mHeader = NULL;
+}
+
+LevelFile::~LevelFile()
+{
+	close();
+}
+
+//Map a level file and check it's one we can use, it stays mapped until it's closed
+bool LevelFile::open( const std::string& path )
+{
+	struct stat info;
+	size_t i;
+	int fd;
+
+	close();
+
+	if( ( fd = ::open( path.c_str(), O_RDONLY ) ) < 0 )
+	{
+		return false;
+	}
+
+	if( fstat( fd, &info ) != 0 || (size_t)info.st_size < sizeof( LevelHeader ) )
+	{
+		::close( fd );
+		return false;
+	}
+
+	void *data = mmap( NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+
+	if( data == MAP_FAILED )
+	{
+		return false;
+	}
+
+	mData	= (sf::Uint8 *)data;
+	mSize	= info.st_size;
+	mHeader = (LevelHeader *)mData;
+
+	const LevelHeader& h		= *mHeader;
+	sf::Uint64	   tilesSize	= (sf::Uint64)h.width * h.height;
+	sf::Uint64	   walkableSize = (sf::Uint64)h.wordsPerRow * h.height * 8;
+	sf::Uint64	   enemiesSize	= (sf::Uint64)h.enemyCount * sizeof( LevelSpawn );
+	sf::Uint64	   areasSize	= (sf::Uint64)h.areaCount * sizeof( RoomArea );
+	sf::Uint64	   portalsSize	= (sf::Uint64)h.portalCount * sizeof( RoomPortal );
+
+	//Anything that doesn't add up is treated the same as there being no file. Every section has to be
+	//inside the file before they're checked against each other, so none of the sums can wrap
+	bool valid = !( std::memcmp( h.magic, LEVEL_MAGIC, 4 ) != 0 || h.version != VERSION || h.fileSize != mSize ||
+			h.wordsPerRow != ( h.width + 63 ) / 64 || h.tilesOffset < sizeof( LevelHeader ) ||
+			!fitsInFile( h.tilesOffset, tilesSize, mSize ) || !fitsInFile( h.walkableOffset, walkableSize, mSize ) ||
+			!fitsInFile( h.enemiesOffset, enemiesSize, mSize ) || !fitsInFile( h.areasOffset, areasSize, mSize ) ||
+			!fitsInFile( h.portalsOffset, portalsSize, mSize ) ||
+			h.tilesOffset + tilesSize > h.walkableOffset || h.walkableOffset % 8 != 0 ||
+			h.walkableOffset + walkableSize > h.enemiesOffset ||
+			h.enemiesOffset + enemiesSize > h.areasOffset || h.areasOffset % 8 != 0 ||
+			h.areasOffset + areasSize > h.portalsOffset || h.portalsOffset % 8 != 0 ||
+			h.playerSpawnX >= h.width || h.playerSpawnY >= h.height );
+
+	//Nor can an enemy off the map or a portal into an area that isn't there, both get used as indices
+	for( i = 0; valid && i < h.enemyCount; i++ )
+	{
+		valid = getEnemySpawns()[i].x < h.width && getEnemySpawns()[i].y < h.height;
+	}
+
+	for( i = 0; valid && i < h.portalCount; i++ )
+	{
+		valid = getPortals()[i].areas[0] < h.areaCount && getPortals()[i].areas[1] < h.areaCount;
+	}
+
+	if( !valid )
+	{
+		std::cout << path << " is not a level file this version can read" << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void LevelFile::close()
+{
+	if( mData != NULL )
+	{
+		munmap( mData, mSize );
+	}
+
+	mData	= NULL;
+	mSize	= 0;
+	mHeader = NULL;
+}
+
+//Whether the level is the same shape as a map, so the map can use it for storage
+bool LevelFile::fits( Map& map ) const
+{
+	return mHeader != NULL && mHeader->width == map.getWidth() && mHeader->height == map.getHeight() &&
+	       mHeader->tileSize == map.getTileSize();
+}
+
+//Save a map to a level file. It's written next to where it's going and renamed into place,
+//so a half written file is never picked up
+bool LevelFile::write( const std::string& path, Map& map, unsigned int seed, sf::Vector2i playerSpawn, const RoomGraph& rooms )
+{
+	std::vector<LevelSpawn> enemies;
+	LevelHeader		h;
+	size_t			x, y;
+
+	for( y = 0; y < map.getHeight(); y++ )
+	{
+		const sf::Uint8 *row = map.getRow( y );
+
+		for( x = 0; x < map.getWidth(); x++ )
+		{
+			if( row[x] == TILE_ENEMY_SPAWN )
+			{
+				LevelSpawn spawn = { (sf::Uint32)x, (sf::Uint32)y };
+				enemies.push_back( spawn );
+			}
+		}
+	}
+
+	std::memset( &h, 0, sizeof( h ) );
+	std::memcpy( h.magic, LEVEL_MAGIC, 4 );
+	h.version	 = VERSION;
+	h.seed		 = seed;
+	h.width		 = map.getWidth();
+	h.height	 = map.getHeight();
+	h.tileSize	 = map.getTileSize();
+	h.wordsPerRow	 = map.getWordsPerRow();
+	h.playerSpawnX	 = playerSpawn.x;
+	h.playerSpawnY	 = playerSpawn.y;
+	h.enemyCount	 = enemies.size();
+	h.areaCount	 = rooms.getAreas().size();
+	h.portalCount	 = rooms.getPortals().size();
+	h.tilesOffset	 = alignOffset( sizeof( h ) );
+	h.walkableOffset = alignOffset( h.tilesOffset + ( (sf::Uint64)h.width * h.height ) );
+	h.enemiesOffset	 = alignOffset( h.walkableOffset + ( (sf::Uint64)h.wordsPerRow * h.height * 8 ) );
+	h.areasOffset	 = alignOffset( h.enemiesOffset + ( enemies.size() * sizeof( LevelSpawn ) ) );
+	h.portalsOffset	 = alignOffset( h.areasOffset + ( h.areaCount * sizeof( RoomArea ) ) );
+	h.fileSize	 = h.portalsOffset + ( h.portalCount * sizeof( RoomPortal ) );
+
+	std::string   temp = path + ".tmp";
+	std::ofstream out( temp, std::ios::binary );
+	std::vector<char> padding( 64, 0 );
+
+	if( !out )
+	{
+		return false;
+	}
+
+	out.write( (const char *)&h, sizeof( h ) );
+	out.write( &padding[0], h.tilesOffset - sizeof( h ) );
+
+	for( y = 0; y < h.height; y++ )
+	{
+		out.write( (const char *)map.getRow( y ), h.width );
+	}
+
+	out.write( &padding[0], h.walkableOffset - ( h.tilesOffset + ( (sf::Uint64)h.width * h.height ) ) );
+
+	for( y = 0; y < h.height; y++ )
+	{
+		out.write( (const char *)map.getWalkableRow( y ), h.wordsPerRow * 8 );
+	}
+
+	out.write( &padding[0], h.enemiesOffset - ( h.walkableOffset + ( (sf::Uint64)h.wordsPerRow * h.height * 8 ) ) );
+
+	if( !enemies.empty() )
+	{
+		out.write( (const char *)&enemies[0], enemies.size() * sizeof( LevelSpawn ) );
+	}
+
+	out.write( &padding[0], h.areasOffset - ( h.enemiesOffset + ( enemies.size() * sizeof( LevelSpawn ) ) ) );
+
+	if( h.areaCount > 0 )
+	{
+		out.write( (const char *)&rooms.getAreas()[0], h.areaCount * sizeof( RoomArea ) );
+	}
+
+	out.write( &padding[0], h.portalsOffset - ( h.areasOffset + ( h.areaCount * sizeof( RoomArea ) ) ) );
+
+	if( h.portalCount > 0 )
+	{
+		out.write( (const char *)&rooms.getPortals()[0], h.portalCount * sizeof( RoomPortal ) );
+	}
+
+	out.close();
+
+	if( !out || std::rename( temp.c_str(), path.c_str() ) != 0 )
+	{
+		std::remove( temp.c_str() );
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,87 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef LEVEL_HPP
+#define LEVEL_HPP
+
+//Start of every level file. Everything after it is aligned and laid out the way Map keeps it in
+//memory, so a mapped file can be used as is without reading or decoding anything
+struct LevelHeader
+{
+	char		magic[4];
+	sf::Uint32	version;
+	sf::Uint32	seed;
+	sf::Uint32	width;
+	sf::Uint32	height;
+	sf::Uint32	tileSize;
+	sf::Uint32	wordsPerRow;
+	sf::Uint32	playerSpawnX;
+	sf::Uint32	playerSpawnY;
+	sf::Uint32	enemyCount;
+	sf::Uint32	areaCount;
+	sf::Uint32	portalCount;
+	sf::Uint64	tilesOffset;
+	sf::Uint64	walkableOffset;
+	sf::Uint64	enemiesOffset;
+	sf::Uint64	areasOffset;
+	sf::Uint64	portalsOffset;
+	sf::Uint64	fileSize;
+};
+
+//Where an enemy starts, in tiles
+struct LevelSpawn
+{
+	sf::Uint32	x;
+	sf::Uint32	y;
+};
+
+//A level file mapped into memory. The mapping is private, so a map using it can change tiles
+//without them ever being written back
+class LevelFile
+{
+public:
+	LevelFile();
+	~LevelFile();
+	bool			open( const std::string& );
+	void			close();
+	bool			fits( Map& ) const;
+	const LevelHeader& getHeader() const { return *mHeader; }
+	sf::Uint8* getRow( size_t y ) { return mData + mHeader->tilesOffset + ( y * mHeader->width ); }
+	sf::Uint64* getWalkableRow( size_t y ) { return (sf::Uint64 *)( mData + mHeader->walkableOffset ) + ( y * mHeader->wordsPerRow ); }
+	const LevelSpawn* getEnemySpawns() const { return (const LevelSpawn *)( mData + mHeader->enemiesOffset ); }
+	const RoomArea* getAreas() const { return (const RoomArea *)( mData + mHeader->areasOffset ); }
+	const RoomPortal* getPortals() const { return (const RoomPortal *)( mData + mHeader->portalsOffset ); }
+	static bool		write( const std::string&, Map&, unsigned int, sf::Vector2i, const RoomGraph& );
+
+	static const sf::Uint32	VERSION = 3;
+
+private:
+	sf::Uint8	*mData;
+	size_t		 mSize;
+	LevelHeader	*mHeader;
+};
+
+#endif
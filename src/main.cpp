@@ -27,15 +27,97 @@
 #include <SFML/Window.hpp>
 #include <SFML/System.hpp>
 #include <SFML/Graphics.hpp>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <map>
+#include <memory>
 
+#include "random.hpp"
+#include "clock.hpp"
+#include "input.hpp"
 #include "entity.hpp"
 #include "map.hpp"
+#include "render.hpp"
+#include "spatial.hpp"
+#include "path.hpp"
+#include "visibility.hpp"
+#include "stream.hpp"
+#include "jobs.hpp"
+#include "profile.hpp"
 #include "game.hpp"
 
 Game game;
 
 int main( int argc, char **argv )
 {
+	std::string	replayPath, timingsPath;
+	int		i;
+
+	for( i = 1; i < argc; i++ )
+	{
+		//Simulation steps per second, independent of the display's refresh rate
+		if( std::strcmp( argv[i], "--tickrate" ) == 0 && i + 1 < argc )
+		{
+			game.setSimulationRate( std::max( 1, std::atoi( argv[++i] ) ) );
+		}
+
+		//The same dungeon every time, cached after the first
+		if( std::strcmp( argv[i], "--seed" ) == 0 && i + 1 < argc )
+		{
+			game.setSeed( std::strtoul( argv[++i], NULL, 10 ) );
+		}
+
+		//How many threads update entities, by default one per core
+		if( std::strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc )
+		{
+			game.setThreadCount( std::strtoul( argv[++i], NULL, 10 ) );
+		}
+
+		//How far from the player slimes are simulated every step, in tiles. Out to twice that they're
+		//simulated every few steps and past that they sleep, 0 simulates everything every step
+		if( std::strcmp( argv[i], "--active-radius" ) == 0 && i + 1 < argc )
+		{
+			game.setActiveRadius( std::strtoul( argv[++i], NULL, 10 ) );
+		}
+
+		//A dungeon without edges, generated around the player as it explores
+		if( std::strcmp( argv[i], "--infinite" ) == 0 )
+		{
+			game.setStreaming( true );
+		}
+
+		//Save the seed and every step's input so the session can be played again
+		if( std::strcmp( argv[i], "--record" ) == 0 && i + 1 < argc )
+		{
+			game.setRecording( argv[++i] );
+		}
+
+		//Play a recording back headless at full speed and time it, per step to a CSV with --timings
+		if( std::strcmp( argv[i], "--replay" ) == 0 && i + 1 < argc )
+		{
+			replayPath = argv[++i];
+		}
+
+		if( std::strcmp( argv[i], "--timings" ) == 0 && i + 1 < argc )
+		{
+			timingsPath = argv[++i];
+		}
+	}
+
+	if( !replayPath.empty() )
+	{
+		return game.replay( replayPath, timingsPath );
+	}
+
 	game.doLoop();
 	return 0;
 }
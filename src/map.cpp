@@ -28,14 +28,20 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/System.hpp>
 #include <iostream>
-#include <random>
-#include <chrono>
 #include <cstring>
-
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "random.hpp"
+#include "clock.hpp"
+#include "input.hpp"
 #include "entity.hpp"
 #include "map.hpp"
-
-std::mt19937 gRanNumGen;
+#include "room.hpp"
+#include "level.hpp"
 
 Map::Map( size_t w, size_t h, size_t ts )
 {
@@ -43,63 +49,211 @@ Map::Map( size_t w, size_t h, size_t ts )
 	mHeight	  = h;
 	mTileSize = ts;
 
-	mMapTexture.create( w * mTileSize, h * mTileSize);
-	mMapTexture.clear( sf::Color::Black );
+	//Tiles are stored a row at a time, x is the fast axis. Alongside them, one bit per tile that's set if it can be walked on
+	mWordsPerRow = ( mWidth + 63 ) / 64;
+	mMapData     = NULL;
+	mWalkable    = NULL;
+	mBorrowed    = false;
 
-	mMapData = new sf::Uint8[mWidth * mHeight];
-	std::memset( mMapData, 0, mWidth * mHeight );
+	setStorage( NULL, NULL );
 }
 
 Map::~Map()
 {
-	delete mMapData;
+	if( !mBorrowed )
+	{
+		delete[] mMapData;
+		delete[] mWalkable;
+	}
 }
 
-sf::Uint8& Map::getTile( size_t x, size_t y ) const
+//Use memory someone else owns for the tiles and walkable bits, like a mapped level file, which has
+//to outlive us or the next call. Passing NULL for both goes back to an empty map of our own
+void Map::setStorage( sf::Uint8 *tiles, sf::Uint64 *walkable )
 {
-	return mMapData[( x * mWidth ) + y];
+	if( !mBorrowed )
+	{
+		delete[] mMapData;
+		delete[] mWalkable;
+	}
+
+	if( tiles != NULL && walkable != NULL )
+	{
+		mMapData  = tiles;
+		mWalkable = walkable;
+		mBorrowed = true;
+		return;
+	}
+
+	mMapData  = new sf::Uint8[mWidth * mHeight];
+	mWalkable = new sf::Uint64[mWordsPerRow * mHeight];
+	mBorrowed = false;
+	clear();
 }
 
-//Make a square of tiles in our map
-void Map::makeSquare( sf::Uint8 type, size_t x, size_t y, size_t w, size_t h )
+void Map::setTile( size_t x, size_t y, sf::Uint8 type )
+{
+	mMapData[( y * mWidth ) + x] = type;
+	setRowBits( y, x, 1, type != TILE_NONE );
+	markDirty( sf::IntRect( x, y, 1, 1 ) );
+}
+
+//Copy in a w by h block of tiles, packed a row at a time
+void Map::setTiles( size_t x, size_t y, size_t w, size_t h, const sf::Uint8 *tiles )
 {
-	int i, j, ci, cj;
+	size_t i, j;
+
+	if( !isSquareInside( x, y, w, h ) )
+	{
+		return;
+	}
 
-	for( i = x, ci = 0; ci < w; i++, ci++ )
+	for( j = 0; j < h; j++ )
 	{
-		for( j = y, cj = 0; cj < h; j++, cj++ )
+		const sf::Uint8 *row = tiles + ( j * w );
+
+		std::memcpy( &mMapData[( ( y + j ) * mWidth ) + x], row, w );
+
+		for( i = 0; i < w; i++ )
 		{
-			getTile( i, j ) = type;
+			sf::Uint64& word = mWalkable[( ( y + j ) * mWordsPerRow ) + ( ( x + i ) / 64 )];
+			sf::Uint64  bit	 = (sf::Uint64)1 << ( ( x + i ) % 64 );
+
+			if( row[i] != TILE_NONE )
+			{
+				word |= bit;
+			}
+			else
+			{
+				word &= ~bit;
+			}
 		}
 	}
+
+	markDirty( sf::IntRect( x, y, w, h ) );
 }
 
-void Map::makeCenteredSquare( sf::Uint8 type, size_t x, size_t y, size_t w, size_t h )
+//Copy out a w by h block of tiles, packed a row at a time
+void Map::getTiles( size_t x, size_t y, size_t w, size_t h, sf::Uint8 *tiles ) const
 {
-	makeSquare( type, x - ( w / 2 ), y - ( h / 2 ), w, h );
+	size_t j;
+
+	if( !isSquareInside( x, y, w, h ) )
+	{
+		return;
+	}
+
+	for( j = 0; j < h; j++ )
+	{
+		std::memcpy( tiles + ( j * w ), &mMapData[( ( y + j ) * mWidth ) + x], w );
+	}
 }
 
-//Render the tiles to a RenderTexture
-void Map::drawTiles( sf::RenderTexture& dst, sf::Sprite src, sf::Uint8 type )
+//Bits first to first + count - 1 of a word, count is at most 64
+static sf::Uint64 getBitMask( size_t first, size_t count )
 {
-	int i, j;
+	sf::Uint64 bits = count >= 64 ? ~(sf::Uint64)0 : ( (sf::Uint64)1 << count ) - 1;
 
-	for( i = 0; i < mWidth; i++ )
+	return bits << first;
+}
+
+//Check count walkable bits of a row starting at x a word at a time, either for all set or for any set
+bool Map::testRowBits( size_t y, size_t x, size_t count, bool all ) const
+{
+	const sf::Uint64	*row	   = &mWalkable[y * mWordsPerRow];
+	size_t			 first	   = x / 64;
+	size_t			 last	   = ( x + count - 1 ) / 64;
+	sf::Uint64		 firstMask = ~(sf::Uint64)0 << ( x % 64 );
+	sf::Uint64		 lastMask  = ~(sf::Uint64)0 >> ( 63 - ( ( x + count - 1 ) % 64 ) );
+	size_t			 i;
+
+	//Most of the time the whole run is inside one word
+	if( first == last )
 	{
-		for( j = 0; j < mHeight; j++ )
+		sf::Uint64 mask = firstMask & lastMask;
+		return all ? ( row[first] & mask ) == mask : ( row[first] & mask ) != 0;
+	}
+
+	if( all )
+	{
+		sf::Uint64 missing = ( ~row[first] & firstMask ) | ( ~row[last] & lastMask );
+
+		for( i = first + 1; i < last; i++ )
 		{
-			if( getTile( i, j ) == type )
-			{
-				//Note that the Y coord is "reversed" to fit with SFML's coordinate system
-				src.setPosition( sf::Vector2f( i * mTileSize, ( mHeight - j ) * mTileSize ) );
-				dst.draw( src );
-			}
+			missing |= ~row[i];
 		}
+
+		return missing == 0;
+	}
+
+	sf::Uint64 found = ( row[first] & firstMask ) | ( row[last] & lastMask );
+
+	for( i = first + 1; i < last; i++ )
+	{
+		found |= row[i];
 	}
+
+	return found != 0;
+}
+
+void Map::setRowBits( size_t y, size_t x, size_t count, bool walkable )
+{
+	sf::Uint64 *row = &mWalkable[y * mWordsPerRow];
+
+	while( count > 0 )
+	{
+		size_t		bit  = x % 64;
+		size_t		take = std::min( count, 64 - bit );
+		sf::Uint64	mask = getBitMask( bit, take );
+
+		if( walkable )
+		{
+			row[x / 64] |= mask;
+		}
+		else
+		{
+			row[x / 64] &= ~mask;
+		}
+
+		x     += take;
+		count -= take;
+	}
+}
+
+bool Map::isSquareInside( size_t x, size_t y, size_t w, size_t h ) const
+{
+	return x < mWidth && y < mHeight && w <= mWidth - x && h <= mHeight - y;
+}
+
+//Make a square of tiles in our map, clipped to the map's edges
+void Map::makeSquare( sf::Uint8 type, size_t x, size_t y, size_t w, size_t h )
+{
+	size_t j;
+
+	if( x >= mWidth || y >= mHeight )
+	{
+		return;
+	}
+
+	w = std::min( w, mWidth - x );
+	h = std::min( h, mHeight - y );
+
+	for( j = y; j < y + h; j++ )
+	{
+		std::memset( &mMapData[( j * mWidth ) + x], type, w );
+		setRowBits( j, x, w, type != TILE_NONE );
+	}
+
+	markDirty( sf::IntRect( x, y, w, h ) );
+}
+
+void Map::makeCenteredSquare( sf::Uint8 type, size_t x, size_t y, size_t w, size_t h )
+{
+	makeSquare( type, x - ( w / 2 ), y - ( h / 2 ), w, h );
 }
 
 //Get the tile enclosing the given coordinate
-sf::Vector2i Map::getTileCoordForPoint( sf::Vector2f point )
+sf::Vector2i Map::getTileCoordForPoint( sf::Vector2f point ) const
 {
 	size_t x = (size_t)point.x;
 	size_t y = (size_t)point.y;
@@ -107,18 +261,18 @@ sf::Vector2i Map::getTileCoordForPoint( sf::Vector2f point )
 	return sf::Vector2i( x / mTileSize, y / mTileSize );
 }
 
-sf::Uint8 Map::getTileForPoint( sf::Vector2f point )
+sf::Uint8 Map::getTileForPoint( sf::Vector2f point ) const
 {
 	return getTile( ( (size_t)point.x ) / mTileSize, ( (size_t)point.y ) / mTileSize );
 }
 
-sf::Vector2f Map::getCoordForTile( size_t x, size_t y )
+sf::Vector2f Map::getCoordForTile( size_t x, size_t y ) const
 {
 	return sf::Vector2f( x * mTileSize, y * mTileSize );
 }
 
 //AABB test to check collision with a given tile
-bool Map::collidesWithTile( sf::FloatRect other, size_t x, size_t y )
+bool Map::collidesWithTile( sf::FloatRect other, size_t x, size_t y ) const
 {
 	sf::FloatRect tile( sf::Vector2f( mTileSize * x, mTileSize * y ), 
 			    sf::Vector2f( mTileSize, mTileSize ) );
@@ -126,39 +280,241 @@ bool Map::collidesWithTile( sf::FloatRect other, size_t x, size_t y )
 	return tile.intersects( other );
 }
 
-//Return true if a given square is empty
-bool Map::isSquareEmpty( size_t x, size_t y, size_t w, size_t h )
+//Return true if a given square is inside the map and empty
+bool Map::isSquareEmpty( size_t x, size_t y, size_t w, size_t h ) const
 {
-	int i, j, ci, cj;
-	
-	for( i = x, ci = 0; ci < w; i++, ci++ )
+	size_t j;
+
+	if( !isSquareInside( x, y, w, h ) )
 	{
-		for( j = y, cj = 0; cj < h; j++, cj++ )
+		return false;
+	}
+
+	for( j = y; j < y + h; j++ )
+	{
+		if( testRowBits( j, x, w, false ) )
 		{
-			if( getTile( i, j ) != TILE_NONE )
-			{
-				return false;
-			}
+			return false;
 		}
 	}
 
 	return true;
 }
 
-bool Map::isTouchingTileType( sf::Uint8 type, sf::FloatRect AABB )
+//True if any tile the AABB's edges are in is of the given type, anything off the map counts as TILE_NONE
+bool Map::isTouchingTileType( sf::Uint8 type, sf::FloatRect AABB ) const
 {
-	if( getTileForPoint( sf::Vector2f( AABB.left, AABB.top ) ) == type ||
-	    getTileForPoint( sf::Vector2f( AABB.left + AABB.width, AABB.top ) ) == type ||
-	    getTileForPoint( sf::Vector2f( AABB.left, AABB.top + AABB.height ) ) == type ||
-	    getTileForPoint( sf::Vector2f( AABB.left + AABB.width, AABB.top + AABB.height ) ) == type )
+	if( AABB.left < 0 || AABB.top < 0 )
 	{
-		return true;
+		return type == TILE_NONE;
+	}
+
+	//Float division pipelines far better than four integer ones
+	float	tileSize = mTileSize;
+	size_t	left	 = (int)( AABB.left / tileSize );
+	size_t	top	 = (int)( AABB.top / tileSize );
+	size_t	right	 = (int)( ( AABB.left + AABB.width ) / tileSize );
+	size_t	bottom	 = (int)( ( AABB.top + AABB.height ) / tileSize );
+	size_t	i, j;
+
+	if( right >= mWidth || bottom >= mHeight )
+	{
+		return type == TILE_NONE;
+	}
+
+	//Everything that isn't TILE_NONE is walkable, so that's a check of whole rows of bits
+	if( type == TILE_NONE )
+	{
+		for( j = top; j <= bottom; j++ )
+		{
+			if( !testRowBits( j, left, ( right - left ) + 1, true ) )
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	for( j = top; j <= bottom; j++ )
+	{
+		for( i = left; i <= right; i++ )
+		{
+			if( getTile( i, j ) == type )
+			{
+				return true;
+			}
+		}
 	}
 
 	return false;
 }
 
-bool Map::isInsideMap( sf::FloatRect AABB )
+//How far past a tile edge a box has to be before it counts as overlapping that tile,
+//so boxes resting exactly against a wall aren't treated as inside it
+static const float SWEEP_EPSILON = 0.001f;
+
+//Move box by delta one axis at a time, each axis stopping flush against the first wall the box would sweep into,
+//so whatever hits a wall at an angle slides along it. Only the tiles the box passes over are looked at, so
+//it can't tunnel through anything however far it's going. Returns how far it actually got, and normal is
+//set to the direction the walls it hit face, or zero on an axis that didn't hit anything
+sf::Vector2f Map::sweep( sf::FloatRect box, sf::Vector2f delta, sf::Vector2i& normal ) const
+{
+	sf::Vector2f moved;
+
+	moved.x	  = sweepAxis( box, delta.x, true );
+	box.left += moved.x;
+	moved.y	  = sweepAxis( box, delta.y, false );
+
+	normal.x = moved.x != delta.x ? ( delta.x > 0.0f ? -1 : 1 ) : 0;
+	normal.y = moved.y != delta.y ? ( delta.y > 0.0f ? -1 : 1 ) : 0;
+
+	return moved;
+}
+
+//Sweep box along one axis, a row or column of tiles at a time across the width of the box.
+//Off the map counts as wall
+float Map::sweepAxis( sf::FloatRect box, float distance, bool horizontal ) const
+{
+	float tileSize = mTileSize;
+	float perTile  = 1.0f / tileSize;
+	float start    = horizontal ? box.left : box.top;
+	float size     = horizontal ? box.width : box.height;
+	float across   = horizontal ? box.top : box.left;
+	float breadth  = horizontal ? box.height : box.width;
+	int   limit    = horizontal ? mWidth : mHeight;
+	int   first    = std::floor( ( across + SWEEP_EPSILON ) * perTile );
+	int   last     = std::floor( ( across + breadth - SWEEP_EPSILON ) * perTile );
+	int   line, end, step;
+
+	if( distance == 0.0f )
+	{
+		return 0.0f;
+	}
+
+	if( first < 0 || last >= ( horizontal ? (int)mHeight : (int)mWidth ) )
+	{
+		return 0.0f;
+	}
+
+	//The first line of tiles the box isn't already over, and the last one it will be
+	if( distance > 0.0f )
+	{
+		line = std::floor( ( start + size - SWEEP_EPSILON ) * perTile ) + 1;
+		end  = std::floor( ( start + size + distance - SWEEP_EPSILON ) * perTile );
+		step = 1;
+	}
+	else
+	{
+		line = std::floor( ( start + SWEEP_EPSILON ) * perTile ) - 1;
+		end  = std::floor( ( start + distance + SWEEP_EPSILON ) * perTile );
+		step = -1;
+	}
+
+	for( ; step > 0 ? line <= end : line >= end; line += step )
+	{
+		bool blocked = line < 0 || line >= limit;
+
+		if( !blocked && horizontal )
+		{
+			for( int y = first; y <= last && !blocked; y++ )
+			{
+				blocked = !isWalkable( line, y );
+			}
+		}
+		else if( !blocked )
+		{
+			blocked = !testRowBits( line, first, last - first + 1, true );
+		}
+
+		//Stop flush against the wall, but never back up
+		if( blocked )
+		{
+			float flush = step > 0 ? ( line * tileSize ) - size : ( line + 1 ) * tileSize;
+
+			return step > 0 ? std::max( 0.0f, flush - start ) : std::min( 0.0f, flush - start );
+		}
+	}
+
+	return distance;
+}
+
+//Back to nothing but TILE_NONE
+void Map::clear()
+{
+	std::memset( mMapData, TILE_NONE, mWidth * mHeight );
+	std::fill( mWalkable, mWalkable + ( mWordsPerRow * mHeight ), 0 );
+
+	mDirty.clear();
+	markDirty( sf::IntRect( 0, 0, mWidth, mHeight ) );
+}
+
+//Past this many separate rects they're all collapsed into the one rect around them
+static const size_t MAX_DIRTY_RECTS = 32;
+
+static sf::IntRect getBounds( sf::IntRect a, sf::IntRect b )
+{
+	int left   = std::min( a.left, b.left );
+	int top	   = std::min( a.top, b.top );
+	int right  = std::max( a.left + a.width, b.left + b.width );
+	int bottom = std::max( a.top + a.height, b.top + b.height );
+
+	return sf::IntRect( left, top, right - left, bottom - top );
+}
+
+//Remember that the tiles in rect changed, so whatever keeps its own copy of them, like the renderer,
+//only has to redo that much. A rect touching the last one marked is merged into it, since changes
+//tend to come in runs over neighbouring tiles
+void Map::markDirty( sf::IntRect rect )
+{
+	size_t i;
+
+	if( rect.width <= 0 || rect.height <= 0 )
+	{
+		return;
+	}
+
+	if( !mDirty.empty() )
+	{
+		sf::IntRect& last = mDirty.back();
+
+		if( rect.left <= last.left + last.width && last.left <= rect.left + rect.width &&
+		    rect.top <= last.top + last.height && last.top <= rect.top + rect.height )
+		{
+			last = getBounds( last, rect );
+			return;
+		}
+	}
+
+	if( mDirty.size() >= MAX_DIRTY_RECTS )
+	{
+		for( i = 1; i < mDirty.size(); i++ )
+		{
+			rect = getBounds( rect, mDirty[i] );
+		}
+
+		mDirty[0] = getBounds( rect, mDirty[0] );
+		mDirty.resize( 1 );
+		return;
+	}
+
+	mDirty.push_back( rect );
+}
+
+//How many tiles can be walked on
+size_t Map::countWalkable() const
+{
+	size_t i, count = 0;
+
+	for( i = 0; i < mWordsPerRow * mHeight; i++ )
+	{
+		count += __builtin_popcountll( mWalkable[i] );
+	}
+
+	return count;
+}
+
+bool Map::isInsideMap( sf::FloatRect AABB ) const
 {
 	return !( AABB.top + AABB.height > mHeight * mTileSize ||
 		  AABB.left < 0 ||
@@ -166,47 +522,61 @@ bool Map::isInsideMap( sf::FloatRect AABB )
 		  AABB.top < 0 );
 }
 
-DungeonMap::DungeonMap() : Map( 512, 512, 16 )
+DungeonGenerator::DungeonGenerator( unsigned int seed ) : mLayout( RandomStream::makeKey( seed, STREAM_DUNGEON_LAYOUT, 0 ) )
 {
-	gRanNumGen.seed( std::chrono::system_clock::now().time_since_epoch().count() );
+	mSeed	    = seed;
+	mRoomCount  = 0;
+	mEnemyCount = 0;
+	mGraph	    = NULL;
+}
 
-	if( !mFloorTexture.loadFromFile( "res/basictiles.png", sf::IntRect( 6 * 16, 1 * 16, 16, 16 ) ) )
-	{
-		std::cout << "Error loading floor texture from res/basictiles.png!" << std::endl;
-	}
+//Carve a spawn room in the middle of the map and three chains of rooms branching off it. If given a graph,
+//every room and hallway goes into it along with the portals joining them
+void DungeonGenerator::generate( Map& map, RoomGraph *graph )
+{
+	mGraph = graph;
 
-	if( !mPlayerSpawnTexture.loadFromFile( "res/basictiles.png", sf::IntRect( 1 * 16, 7 * 16, 16, 16 ) ) )
+	if( mGraph != NULL )
 	{
-		std::cout << "Error loading floor texture from res/basictiles.png!" << std::endl;
+		mGraph->clear();
 	}
 
-	sf::IntRect spawnRect = makeSpawnRoom( 256, 256, 10, 10 );
+	sf::IntRect spawnRect = makeSpawnRoom( map, map.getWidth() / 2, map.getHeight() / 2, 10, 10 );
+	size_t	    spawnArea = addArea( spawnRect, AREA_SPAWN_ROOM, 0 );
 	
-	generateRooms( spawnRect, 10 );
-	generateRooms( spawnRect, 10 );
-	generateRooms( spawnRect, 10 );
+	generateRooms( map, spawnRect, spawnArea, 10 );
+	generateRooms( map, spawnRect, spawnArea, 10 );
+	generateRooms( map, spawnRect, spawnArea, 10 );
 
-	drawTiles( mMapTexture, sf::Sprite( mFloorTexture ), TILE_FLOOR );
-	drawTiles( mMapTexture, sf::Sprite( mFloorTexture ), TILE_ENEMY_SPAWN );
-	drawTiles( mMapTexture, sf::Sprite( mPlayerSpawnTexture ), TILE_PLAYER_SPAWN );
-	mMapSprite.setTexture( mMapTexture.getTexture() );
+	if( mGraph != NULL )
+	{
+		mGraph->build( map.getWidth(), map.getHeight() );
+	}
 }
 
-sf::Sprite& DungeonMap::getSprite()
+//Index of the area in the graph, there's nothing to index when we aren't building one
+size_t DungeonGenerator::addArea( sf::IntRect rect, sf::Uint32 kind, size_t enemyCount )
 {
-	return mMapSprite;
+	if( mGraph == NULL )
+	{
+		return 0;
+	}
+
+	return mGraph->addArea( rect, kind, enemyCount );
 }
 
-sf::IntRect DungeonMap::makeSpawnRoom( size_t x, size_t y, size_t w, size_t h )
+sf::IntRect DungeonGenerator::makeSpawnRoom( Map& map, size_t x, size_t y, size_t w, size_t h )
 {
-	makeSquare( TILE_FLOOR, x, y, w, h );
+	map.makeSquare( TILE_FLOOR, x, y, w, h );
 	
-	getTile( x + ( w / 2 ), y + ( h / 2 ) ) = TILE_PLAYER_SPAWN; 
+	map.setTile( x + ( w / 2 ), y + ( h / 2 ), TILE_PLAYER_SPAWN );
+
+	mRoomCount++;
 
 	return sf::IntRect( x, y, w, h );
 }
 
-void DungeonMap::makeHallway( int direction, size_t x, size_t y, size_t length )
+void DungeonGenerator::makeHallway( Map& map, int direction, size_t x, size_t y, size_t length )
 {
 	int i, j, c;
 
@@ -215,64 +585,54 @@ void DungeonMap::makeHallway( int direction, size_t x, size_t y, size_t length )
 	case DIRECTION_UP:
 		for( i = x, j = y, c = 0; c < length; c++, j-- )
 		{
-			getTile( i, j ) = TILE_FLOOR;
+			map.setTile( i, j, TILE_FLOOR );
 		}
 		break;
 
 	case DIRECTION_DOWN:
 		for( i = x, j = y, c = 0; c < length; c++, j++ )
 		{
-			getTile( i, j ) = TILE_FLOOR;
+			map.setTile( i, j, TILE_FLOOR );
 		}
 		break;
 
 	case DIRECTION_RIGHT:
 		for( i = x, j = y, c = 0; c < length; c++, i++ )
 		{
-			getTile( i, j ) = TILE_FLOOR;
+			map.setTile( i, j, TILE_FLOOR );
 		}
 		break;
 
 	case DIRECTION_LEFT:
 		for( i = x, j = y, c = 0; c < length; c++, i-- )
 		{
-			getTile( i, j ) = TILE_FLOOR;
+			map.setTile( i, j, TILE_FLOOR );
 		}
 		break;
 	}
 }
 
-//Get the first player spawn in the map from bottom to top
-sf::Vector2f DungeonMap::getPlayerSpawn()
+void DungeonGenerator::furnishRoom( Map& map, sf::IntRect room, bool placeExit )
 {
-	int i, j;
+	RandomStream random( RandomStream::makeKey( mSeed, STREAM_DUNGEON_ROOM, mRoomCount ) );
+	int	     count = random.nextInt( 0, 5 );
+	int	     i;
 
-	for( i = 0; i < mWidth; i++ )
+	for( i = 0; i < count; i++ )
 	{
-		for( j = 0; j < mHeight; j++ )
+		int x = room.left + random.nextInt( 0, room.width - 1 );
+		int y = room.top + random.nextInt( 0, room.height - 1 );
+
+		if( map.getTile( x, y ) != TILE_ENEMY_SPAWN )
 		{
-			if( getTile( i, j ) == TILE_PLAYER_SPAWN )
-			{
-				return sf::Vector2f( i * mTileSize, j * mTileSize );
-			}
+			map.setTile( x, y, TILE_ENEMY_SPAWN );
+			mEnemyCount++;
 		}
 	}
 }
 
-void DungeonMap::furnishRoom( sf::IntRect room, bool placeExit )
-{
-	int i;
-	std::uniform_int_distribution<int> enemyAmount( 0, 5 );
-	std::uniform_int_distribution<int> enemyX( 0, room.width - 1 );
-	std::uniform_int_distribution<int> enemyY( 0, room.height - 1 );
-
-	for( i = 0; i < enemyAmount( gRanNumGen ); i++ )
-	{
-		getTile( room.left + enemyX( gRanNumGen ), room.top + enemyY( gRanNumGen ) ) = TILE_ENEMY_SPAWN;
-	}
-}
-
-sf::IntRect DungeonMap::generateRooms( sf::IntRect start, size_t depth )
+//Start is the room to branch off and startArea where it is in the graph
+sf::IntRect DungeonGenerator::generateRooms( Map& map, sf::IntRect start, size_t startArea, size_t depth )
 {
 	if( depth == 0 )
 	{
@@ -292,11 +652,8 @@ sf::IntRect DungeonMap::generateRooms( sf::IntRect start, size_t depth )
 
 	sf::IntRect result;
 
-	std::uniform_int_distribution<int> dirRand( 0, 3 );
-	std::uniform_int_distribution<int> subDepthRand( 0, 5 );
-
-	int	direction = dirRand( gRanNumGen );
-	int	subDepth  = subDepthRand( gRanNumGen );
+	int	direction = mLayout.nextInt( 0, 3 );
+	int	subDepth  = mLayout.nextInt( 0, 5 );
 
 	switch( direction )
 	{
@@ -337,25 +694,159 @@ sf::IntRect DungeonMap::generateRooms( sf::IntRect start, size_t depth )
 		break;
 	}
 
-	if( !isInsideMap( sf::FloatRect( hallStart.x * mTileSize, hallStart.y * mTileSize, targetHallWidth * mTileSize, targetHallHeight * mTileSize ) ) ||
-	    !isInsideMap( sf::FloatRect( roomStart.x, roomStart.y, roomWidth, roomHeight ) ) )	
+	size_t tileSize = map.getTileSize();
+
+	if( !map.isInsideMap( sf::FloatRect( hallStart.x * tileSize, hallStart.y * tileSize, targetHallWidth * tileSize, targetHallHeight * tileSize ) ) ||
+	    !map.isInsideMap( sf::FloatRect( roomStart.x * tileSize, roomStart.y * tileSize, roomWidth * tileSize, roomHeight * tileSize ) ) )
 	{
 		return start;
 	}
 
-	if( !isSquareEmpty( hallStart.x, hallStart.y, targetHallWidth, targetHallHeight ) ||
-	    !isSquareEmpty( roomStart.x, roomStart.y, roomWidth, roomHeight ) )
+	if( !map.isSquareEmpty( hallStart.x, hallStart.y, targetHallWidth, targetHallHeight ) ||
+	    !map.isSquareEmpty( roomStart.x, roomStart.y, roomWidth, roomHeight ) )
 	{
-		return generateRooms( start, --depth );
+		return generateRooms( map, start, startArea, --depth );
 	}
 
-	makeSquare( TILE_FLOOR, hallStart.x, hallStart.y, targetHallWidth, targetHallHeight );
-	makeSquare( TILE_FLOOR, roomStart.x, roomStart.y, roomWidth, roomHeight );
+	map.makeSquare( TILE_FLOOR, hallStart.x, hallStart.y, targetHallWidth, targetHallHeight );
+	map.makeSquare( TILE_FLOOR, roomStart.x, roomStart.y, roomWidth, roomHeight );
+
+	size_t enemies = mEnemyCount;
 
 	result = sf::IntRect( roomStart, sf::Vector2i( roomWidth, roomHeight ) );
-	furnishRoom( result, false );
+	furnishRoom( map, result, false );
+	mRoomCount++;
+
+	size_t hallArea = addArea( sf::IntRect( hallStart, sf::Vector2i( targetHallWidth, targetHallHeight ) ), AREA_HALLWAY, 0 );
+	size_t roomArea = addArea( result, AREA_ROOM, mEnemyCount - enemies );
 
-	generateRooms( result, subDepth );
+	if( mGraph != NULL )
+	{
+		mGraph->addPortal( startArea, hallArea );
+		mGraph->addPortal( hallArea, roomArea );
+	}
+
+	generateRooms( map, result, roomArea, subDepth );
 	
-	return generateRooms( result, --depth );
+	return generateRooms( map, result, roomArea, --depth );
+}
+
+//Empty until it's generated or loaded
+DungeonMap::DungeonMap() : Map( 512, 512, 16 )
+{
+	mSeed  = 0;
+	mLevel = NULL;
+	mRooms = new RoomGraph;
+}
+
+//Build the same dungeon every time for a given seed
+DungeonMap::DungeonMap( unsigned int seed ) : Map( 512, 512, 16 )
+{
+	mLevel = NULL;
+	mRooms = new RoomGraph;
+	generate( seed );
+}
+
+//For subclasses that fill the map in themselves
+DungeonMap::DungeonMap( size_t w, size_t h ) : Map( w, h, 16 )
+{
+	mSeed  = 0;
+	mLevel = NULL;
+	mRooms = new RoomGraph;
+}
+
+//Our tiles may live in the level file, so let go of them before it's unmapped
+DungeonMap::~DungeonMap()
+{
+	setStorage( NULL, NULL );
+	delete mLevel;
+	delete mRooms;
+}
+
+//Throw away whatever we had and generate the dungeon for a seed
+void DungeonMap::generate( unsigned int seed )
+{
+	DungeonGenerator generator( seed );
+
+	if( mLevel != NULL )
+	{
+		setStorage( NULL, NULL );
+		delete mLevel;
+		mLevel = NULL;
+	}
+
+	mSeed = seed;
+	clear();
+	generator.generate( *this, mRooms );
+	findPlayerSpawn();
+}
+
+//Use the cached dungeon for a seed straight out of its file if there is one. If not, generate it
+//and cache it for next time. Returns whether it came from the cache
+bool DungeonMap::load( unsigned int seed, const std::string& directory )
+{
+	std::string path  = directory + "/dungeon-" + std::to_string( seed ) + ".nzl";
+	LevelFile  *level = new LevelFile;
+
+	if( level->open( path ) && level->fits( *this ) && level->getHeader().seed == seed )
+	{
+		setStorage( level->getRow( 0 ), level->getWalkableRow( 0 ) );
+		delete mLevel;
+		mLevel = level;
+
+		mSeed	     = seed;
+		mPlayerSpawn = sf::Vector2i( level->getHeader().playerSpawnX, level->getHeader().playerSpawnY );
+
+		mRooms->assign( level->getAreas(), level->getHeader().areaCount, level->getPortals(), level->getHeader().portalCount );
+		mRooms->build( getWidth(), getHeight() );
+		return true;
+	}
+
+	delete level;
+	generate( seed );
+
+	mkdir( directory.c_str(), 0755 );
+
+	if( !LevelFile::write( path, *this, seed, mPlayerSpawn, *mRooms ) )
+	{
+		std::cout << "Couldn't cache the dungeon in " << path << std::endl;
+	}
+
+	return false;
+}
+
+//Which part of the tile sheet each of our tile types is drawn with
+sf::IntRect DungeonMap::getTileRect( sf::Uint8 type )
+{
+	switch( type )
+	{
+	case TILE_FLOOR:
+	case TILE_ENEMY_SPAWN:
+		return sf::IntRect( 6 * 16, 1 * 16, 16, 16 );
+
+	case TILE_PLAYER_SPAWN:
+		return sf::IntRect( 1 * 16, 7 * 16, 16, 16 );
+	}
+
+	return sf::IntRect();
+}
+
+//Remember the first player spawn in the map from top to bottom
+void DungeonMap::findPlayerSpawn()
+{
+	int i, j;
+
+	mPlayerSpawn = sf::Vector2i( 0, 0 );
+
+	for( j = 0; j < mHeight; j++ )
+	{
+		for( i = 0; i < mWidth; i++ )
+		{
+			if( getTile( i, j ) == TILE_PLAYER_SPAWN )
+			{
+				mPlayerSpawn = sf::Vector2i( i, j );
+				return;
+			}
+		}
+	}
 }
@@ -27,7 +27,8 @@
 #ifndef MAP_HPP
 #define MAP_HPP
 
-extern std::mt19937 gRanNumGen;
+class LevelFile;
+class RoomGraph;
 
 
 enum {
@@ -43,30 +44,73 @@ class Map
 public:
 	Map( size_t, size_t, size_t );
 	~Map();
-	sf::Uint8& getTile( size_t, size_t ) const;
+	sf::Uint8 getTile( size_t x, size_t y ) const { return mMapData[( y * mWidth ) + x]; }
+	const sf::Uint8* getRow( size_t y ) const { return &mMapData[y * mWidth]; }
+	void		setTile( size_t, size_t, sf::Uint8 );
+	void		setTiles( size_t, size_t, size_t, size_t, const sf::Uint8 * );
+	void		getTiles( size_t, size_t, size_t, size_t, sf::Uint8 * ) const;
+	bool isWalkable( size_t x, size_t y ) const { return ( mWalkable[( y * mWordsPerRow ) + ( x / 64 )] >> ( x % 64 ) ) & 1; }
+	const sf::Uint64* getWalkableRow( size_t y ) const { return &mWalkable[y * mWordsPerRow]; }
+	size_t getWordsPerRow() const { return mWordsPerRow; }
 	void		makeSquare( sf::Uint8, size_t, size_t, size_t, size_t );
 	void		makeCenteredSquare( sf::Uint8, size_t, size_t, size_t, size_t );
-	virtual sf::Sprite& getSprite() = 0;
-	void		drawTiles( sf::RenderTexture&, sf::Sprite, sf::Uint8 );
-	sf::Vector2i	getTileCoordForPoint( sf::Vector2f );
-	sf::Uint8 getTileForPoint( sf::Vector2f );
-	bool		collidesWithTile( sf::FloatRect, size_t, size_t );
-	size_t getWidth() { return mWidth; }
-	size_t getHeight() { return mHeight; }
-	size_t getTileSize() { return mTileSize; }
-	sf::FloatRect getAABB() { return sf::FloatRect( sf::Vector2f( 0, 0 ), sf::Vector2f( mWidth * mTileSize, mHeight * mTileSize ) ); }
-	bool isSquareEmpty( size_t, size_t, size_t, size_t );
-	bool isTouchingTileType( sf::Uint8, sf::FloatRect );
-	sf::Vector2f getCoordForTile( size_t, size_t );
-	bool isInsideMap( sf::FloatRect );
+	sf::Vector2i	getTileCoordForPoint( sf::Vector2f ) const;
+	sf::Uint8 getTileForPoint( sf::Vector2f ) const;
+	bool		collidesWithTile( sf::FloatRect, size_t, size_t ) const;
+	size_t getWidth() const { return mWidth; }
+	size_t getHeight() const { return mHeight; }
+	size_t getTileSize() const { return mTileSize; }
+	sf::FloatRect getAABB() const { return sf::FloatRect( sf::Vector2f( 0, 0 ), sf::Vector2f( mWidth * mTileSize, mHeight * mTileSize ) ); }
+	bool isSquareEmpty( size_t, size_t, size_t, size_t ) const;
+	bool isTouchingTileType( sf::Uint8, sf::FloatRect ) const;
+	sf::Vector2f getCoordForTile( size_t, size_t ) const;
+	bool isInsideMap( sf::FloatRect ) const;
+	sf::Vector2f	sweep( sf::FloatRect, sf::Vector2f, sf::Vector2i& ) const;
+	void clear();
+	size_t countWalkable() const;
+	void		markDirty( sf::IntRect );
+	const std::vector<sf::IntRect>& getDirtyRects() const { return mDirty; }
+	void clearDirty() { mDirty.clear(); }
 
 protected:
+	void	setStorage( sf::Uint8 *, sf::Uint64 * );
+	bool	isSquareInside( size_t, size_t, size_t, size_t ) const;
+	bool	testRowBits( size_t, size_t, size_t, bool ) const;
+	float	sweepAxis( sf::FloatRect, float, bool ) const;
+	void	setRowBits( size_t, size_t, size_t, bool );
+
 	sf::Uint8		*mMapData;
 	size_t			 mWidth;
 	size_t			 mHeight;
 	size_t			 mTileSize;
-	sf::RenderTexture	 mMapTexture;
-	sf::Sprite		 mMapSprite;
+	size_t			 mWordsPerRow;
+	sf::Uint64		*mWalkable;
+	bool			 mBorrowed;
+	std::vector<sf::IntRect>	 mDirty;
+};
+
+//Carves rooms and hallways into a map. The layout and each room's furnishing draw from their own streams,
+//so changing how rooms are furnished doesn't move them around
+class DungeonGenerator
+{
+public:
+	DungeonGenerator( unsigned int );
+	void generate( Map&, RoomGraph * = NULL );
+	size_t getRoomCount() { return mRoomCount; }
+	size_t getEnemyCount() { return mEnemyCount; }
+
+private:
+	sf::IntRect generateRooms( Map&, sf::IntRect, size_t, size_t );
+	void furnishRoom( Map&, sf::IntRect, bool );
+	size_t addArea( sf::IntRect, sf::Uint32, size_t );
+	sf::IntRect makeSpawnRoom( Map&, size_t, size_t, size_t, size_t );
+	void makeHallway( Map&, int, size_t, size_t, size_t );
+
+	unsigned int	mSeed;
+	RandomStream	mLayout;
+	size_t		mRoomCount;
+	size_t		mEnemyCount;
+	RoomGraph	*mGraph;
 };
 
 //Map subclass used for the main game
@@ -74,17 +118,24 @@ class DungeonMap : public Map
 {
 public:
 	DungeonMap();
-	sf::Sprite& getSprite();
-	sf::Vector2f getPlayerSpawn();
+	DungeonMap( unsigned int );
+	~DungeonMap();
+	void generate( unsigned int );
+	bool load( unsigned int, const std::string& );
+	sf::Vector2f getPlayerSpawn() { return getCoordForTile( mPlayerSpawn.x, mPlayerSpawn.y ); }
+	sf::IntRect getTileRect( sf::Uint8 );
+	unsigned int getSeed() { return mSeed; }
+	const RoomGraph& getRooms() const { return *mRooms; }
+	const LevelFile* getLevel() const { return mLevel; }
 
-private:
-	sf::IntRect generateRooms( sf::IntRect, size_t );
-	void furnishRoom( sf::IntRect, bool );
-	sf::IntRect makeSpawnRoom( size_t, size_t, size_t, size_t );
-	void makeHallway( int, size_t, size_t, size_t );
+protected:
+	DungeonMap( size_t, size_t );
+	void findPlayerSpawn();
 
-	sf::Texture	mFloorTexture;
-	sf::Texture	mPlayerSpawnTexture;
+	unsigned int	 mSeed;
+	sf::Vector2i	 mPlayerSpawn;
+	LevelFile	*mLevel;
+	RoomGraph	*mRooms;
 };
 
 #endif
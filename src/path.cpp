@@ -0,0 +1,175 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "random.hpp"
+#include "clock.hpp"
+#include "input.hpp"
+#include "entity.hpp"
+#include "map.hpp"
+#include "path.hpp"
+
+//Steps for each direction, in tiles
+static const int gStepX[4] = { 1, -1, 0, 0 };
+static const int gStepY[4] = { 0, 0, -1, 1 };
+
+//The direction that undoes each direction
+static const int gOpposite[4] = { DIRECTION_LEFT, DIRECTION_RIGHT, DIRECTION_DOWN, DIRECTION_UP };
+
+const unsigned short FlowField::UNREACHED;
+
+//Radius is in tiles of walking distance from the goal
+FlowField::FlowField( size_t radius )
+{
+	mRadius	    = radius;
+	mWidth	    = 0;
+	mHeight	    = 0;
+	mValid	    = false;
+	mBuildCount = 0;
+}
+
+void FlowField::resize( Map& map )
+{
+	mWidth	= map.getWidth();
+	mHeight = map.getHeight();
+	mValid	= false;
+
+	mDistance.assign( mWidth * mHeight, UNREACHED );
+	mDirection.assign( mWidth * mHeight, NO_DIRECTION );
+	mVisited.clear();
+}
+
+//The tile offset of one step in a direction
+sf::Vector2i FlowField::getStep( int direction )
+{
+	return sf::Vector2i( gStepX[direction], gStepY[direction] );
+}
+
+bool FlowField::isInside( sf::Vector2i tile ) const
+{
+	return tile.x >= 0 && tile.y >= 0 && tile.x < (int)mWidth && tile.y < (int)mHeight;
+}
+
+//Point the field at a new goal tile, only rebuilding it if the goal actually moved to another tile
+bool FlowField::update( Map& map, sf::Vector2i goal )
+{
+	if( mValid && goal == mGoal )
+	{
+		return false;
+	}
+
+	mGoal = goal;
+	build( map );
+
+	return true;
+}
+
+//Flood out from the goal, each newly reached tile pointing back at the tile it was reached from
+void FlowField::build( Map& map )
+{
+	size_t i, head;
+	int    d;
+
+	//Only undo what the last build touched, so a rebuild costs the radius rather than the map
+	for( i = 0; i < mVisited.size(); i++ )
+	{
+		mDistance[mVisited[i]]	= UNREACHED;
+		mDirection[mVisited[i]] = NO_DIRECTION;
+	}
+
+	mVisited.clear();
+	mValid = true;
+	mBuildCount++;
+
+	if( !isInside( mGoal ) || !map.isWalkable( mGoal.x, mGoal.y ) )
+	{
+		return;
+	}
+
+	mDistance[( mGoal.y * mWidth ) + mGoal.x] = 0;
+	mVisited.push_back( ( mGoal.y * mWidth ) + mGoal.x );
+
+	//mVisited doubles as the queue, tiles are appended in the order they're reached
+	for( head = 0; head < mVisited.size(); head++ )
+	{
+		size_t		index	 = mVisited[head];
+		unsigned short	distance = mDistance[index];
+		sf::Vector2i	tile( index % mWidth, index / mWidth );
+
+		if( distance >= mRadius )
+		{
+			continue;
+		}
+
+		for( d = 0; d < 4; d++ )
+		{
+			sf::Vector2i next( tile.x + gStepX[d], tile.y + gStepY[d] );
+
+			if( !isInside( next ) || !map.isWalkable( next.x, next.y ) )
+			{
+				continue;
+			}
+
+			size_t nextIndex = ( next.y * mWidth ) + next.x;
+
+			if( mDistance[nextIndex] != UNREACHED )
+			{
+				continue;
+			}
+
+			mDistance[nextIndex]  = distance + 1;
+			mDirection[nextIndex] = gOpposite[d];
+			mVisited.push_back( nextIndex );
+		}
+	}
+}
+
+//Which way to step from a tile to get closer to the goal, NO_DIRECTION if it's out of reach or the goal itself
+int FlowField::getDirection( sf::Vector2i tile ) const
+{
+	if( !isInside( tile ) )
+	{
+		return NO_DIRECTION;
+	}
+
+	return mDirection[( tile.y * mWidth ) + tile.x];
+}
+
+unsigned short FlowField::getDistance( sf::Vector2i tile ) const
+{
+	if( !isInside( tile ) )
+	{
+		return UNREACHED;
+	}
+
+	return mDistance[( tile.y * mWidth ) + tile.x];
+}
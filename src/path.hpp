@@ -0,0 +1,67 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef PATH_HPP
+#define PATH_HPP
+
+enum {
+	NO_DIRECTION = -1
+};
+
+//Breadth-first distances to a goal tile for every walkable tile within a radius of it,
+//plus which way to step from each of them, so any number of chasers can look their way up
+class FlowField
+{
+public:
+	FlowField( size_t = 48 );
+	void		resize( Map& );
+	bool		update( Map&, sf::Vector2i );
+	void		invalidate() { mValid = false; }
+	int		getDirection( sf::Vector2i ) const;
+	unsigned short	getDistance( sf::Vector2i ) const;
+	sf::Vector2i getGoal() { return mGoal; }
+	size_t getRadius() { return mRadius; }
+	size_t getBuildCount() { return mBuildCount; }
+	static sf::Vector2i getStep( int );
+
+	static const unsigned short UNREACHED = 0xffff;
+
+private:
+	void		build( Map& );
+	bool		isInside( sf::Vector2i ) const;
+
+	size_t				mRadius;
+	size_t				mWidth;
+	size_t				mHeight;
+	sf::Vector2i			mGoal;
+	bool				mValid;
+	size_t				mBuildCount;
+	std::vector<unsigned short>	mDistance;
+	std::vector<sf::Int8>		mDirection;
+	std::vector<size_t>		mVisited;
+};
+
+#endif
@@ -0,0 +1,427 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+#include "profile.hpp"
+
+//Events each thread keeps, a power of two so the ring can wrap with a mask
+static const size_t RING_SIZE = 1 << 15;
+
+//Frames the overlay's averages and p99 are taken over
+static const size_t HISTORY = 240;
+
+//Overlay layout, in pixels
+static const float ROW_HEIGHT	   = 10.0f;
+static const float ROW_GAP	   = 2.0f;
+static const float PIXELS_PER_MS   = 12.0f;
+static const float PIXELS_PER_CALL = 4.0f;
+static const float PANEL_WIDTH	   = 240.0f;
+
+Profiler gProfiler;
+
+#ifdef NOZOKI_PROFILE
+//Every heap allocation the game makes, so the overlay can show whether a frame made any
+static std::atomic<size_t> gAllocations( 0 );
+
+void* operator new( size_t size )
+{
+	gAllocations.fetch_add( 1, std::memory_order_relaxed );
+
+	if( void *memory = std::malloc( size ? size : 1 ) )
+	{
+		return memory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete( void *memory ) noexcept
+{
+	std::free( memory );
+}
+#endif
+
+//Holds the ring of the thread that's running and hands it back when the thread exits, so threads
+//started for every level load don't each leave one behind
+struct RingHolder
+{
+	ProfileRing	*ring;
+
+	~RingHolder()
+	{
+		if( ring != NULL )
+		{
+			gProfiler.releaseRing( ring );
+		}
+	}
+};
+
+static thread_local RingHolder tRing = { NULL };
+
+ProfileRing::ProfileRing( size_t size ) : mEvents( size ), mHead( 0 )
+{
+	mThread = 0;
+}
+
+//Only the owning thread calls this, the head is published after the event so readers never see half of one
+void ProfileRing::push( const ProfileEvent& event )
+{
+	size_t head = mHead.load( std::memory_order_relaxed );
+
+	mEvents[head & ( mEvents.size() - 1 )] = event;
+	mHead.store( head + 1, std::memory_order_release );
+}
+
+//Copy out the events from first up to the head and return where the copy starts. The owner keeps writing
+//while we read, so the head is read again afterwards and anything it could have written over in the
+//meantime is dropped instead of trusted
+size_t ProfileRing::copy( size_t first, std::vector<ProfileEvent>& events ) const
+{
+	size_t size = mEvents.size();
+	size_t head = mHead.load( std::memory_order_acquire );
+	size_t i;
+
+	if( head - first > size )
+	{
+		first = head - size;
+	}
+
+	events.clear();
+	events.reserve( size );
+
+	for( i = first; i != head; i++ )
+	{
+		events.push_back( mEvents[i & ( size - 1 )] );
+	}
+
+	std::atomic_thread_fence( std::memory_order_acquire );
+	size_t newHead = mHead.load( std::memory_order_relaxed );
+
+	//The event at newHead may be half written over the one a ring's length before it
+	if( newHead - first >= size )
+	{
+		size_t lapped = std::min( newHead - first - size + 1, events.size() );
+
+		events.erase( events.begin(), events.begin() + lapped );
+		first += lapped;
+	}
+
+	return first;
+}
+
+//The profiler is created before main, so the main thread always gets the first ring. Builds without
+//profiling never record anything and never get one
+Profiler::Profiler()
+{
+	mEpoch	     = 0;
+	mEpoch	     = now();
+	mFrames	     = 0;
+	mAllocations = 0;
+
+#ifdef NOZOKI_PROFILE
+	getRing();
+#endif
+}
+
+Profiler::~Profiler()
+{
+	for( auto it = mRings.begin(); it != mRings.end(); it++ )
+	{
+		delete *it;
+	}
+}
+
+sf::Int64 Profiler::now() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() - mEpoch;
+}
+
+//A thread's first event gives it a ring, one a finished thread gave back if there is one. After that
+//it never has to lock anything
+ProfileRing* Profiler::getRing()
+{
+	if( tRing.ring == NULL )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		if( !mFreeRings.empty() )
+		{
+			tRing.ring = mFreeRings.back();
+			mFreeRings.pop_back();
+		}
+		else
+		{
+			tRing.ring = new ProfileRing( RING_SIZE );
+			tRing.ring->mThread = mRings.size();
+			mRings.push_back( tRing.ring );
+			mCursors.push_back( 0 );
+		}
+	}
+
+	return tRing.ring;
+}
+
+//A thread that's exiting is done with its ring. It stays readable, what's in it is kept until the
+//next thread to take it writes over it
+void Profiler::releaseRing( ProfileRing *ring )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	mFreeRings.push_back( ring );
+}
+
+void Profiler::record( const char *name, sf::Int64 start, sf::Int64 end )
+{
+	ProfileEvent event = { name, start, end - start, false };
+
+	getRing()->push( event );
+}
+
+void Profiler::count( const char *name, size_t value )
+{
+	ProfileEvent event = { name, now(), (sf::Int64)value, true };
+
+	getRing()->push( event );
+}
+
+//Zones are told apart by name rather than by pointer, the same literal can live at different addresses
+Profiler::Zone& Profiler::getZone( const char *name, bool counter )
+{
+	for( auto it = mZones.begin(); it != mZones.end(); it++ )
+	{
+		if( it->counter == counter && std::strcmp( it->name, name ) == 0 )
+		{
+			return *it;
+		}
+	}
+
+	Zone zone;
+
+	zone.name    = name;
+	zone.counter = counter;
+	zone.frame   = 0.0f;
+	zone.history.assign( HISTORY, 0.0f );
+	mZones.push_back( zone );
+
+	return mZones.back();
+}
+
+//Called once per frame on the main thread, adds up everything recorded since the last one
+void Profiler::endFrame()
+{
+#ifdef NOZOKI_PROFILE
+	size_t allocations = gAllocations.load( std::memory_order_relaxed );
+
+	count( "allocations", allocations - mAllocations );
+	mAllocations = allocations;
+#endif
+
+	std::lock_guard<std::mutex> lock( mMutex );
+	size_t i;
+
+	for( i = 0; i < mRings.size(); i++ )
+	{
+		mCursors[i] = mRings[i]->copy( mCursors[i], mCopy ) + mCopy.size();
+
+		for( auto event = mCopy.begin(); event != mCopy.end(); event++ )
+		{
+			Zone& zone = getZone( event->name, event->counter );
+
+			zone.frame += event->counter ? (float)event->value : event->value / 1000000.0f;
+		}
+	}
+
+	for( auto it = mZones.begin(); it != mZones.end(); it++ )
+	{
+		it->history[mFrames % HISTORY] = it->frame;
+		it->frame = 0.0f;
+	}
+
+	mFrames++;
+}
+
+//Zones are in milliseconds per frame, counters in whatever they count per frame
+void Profiler::getStats( std::vector<ProfileStats>& stats ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::vector<float> samples;
+	size_t frames = std::min( mFrames, HISTORY );
+
+	stats.clear();
+
+	if( frames == 0 )
+	{
+		return;
+	}
+
+	for( auto it = mZones.begin(); it != mZones.end(); it++ )
+	{
+		ProfileStats s;
+		float total = 0.0f;
+
+		samples.assign( it->history.begin(), it->history.begin() + frames );
+
+		for( auto sample = samples.begin(); sample != samples.end(); sample++ )
+		{
+			total += *sample;
+		}
+
+		std::nth_element( samples.begin(), samples.begin() + ( frames - 1 ) * 99 / 100, samples.end() );
+
+		s.name	  = it->name;
+		s.counter = it->counter;
+		s.average = total / frames;
+		s.p99	  = samples[( frames - 1 ) * 99 / 100];
+		stats.push_back( s );
+	}
+}
+
+void Profiler::printStats() const
+{
+	std::vector<ProfileStats> stats;
+
+	getStats( stats );
+
+	std::cout << std::left << std::setw( 24 ) << "zone" << std::right
+		  << std::setw( 10 ) << "avg" << std::setw( 10 ) << "p99" << std::endl;
+
+	for( auto it = stats.begin(); it != stats.end(); it++ )
+	{
+		std::cout << std::left << std::setw( 24 ) << it->name << std::right << std::fixed << std::setprecision( 3 )
+			  << std::setw( 10 ) << it->average << std::setw( 10 ) << it->p99
+			  << ( it->counter ? "" : " ms" ) << std::endl;
+	}
+}
+
+//Writes every event still in the rings as Chrome's trace event format, for chrome://tracing or Perfetto.
+//The threads keep recording while it runs, each ring is copied first and only what they can't have
+//written over since is written out
+bool Profiler::writeTrace( const std::string& path ) const
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+	std::ofstream	out( path.c_str() );
+	bool		first = true;
+	size_t		i;
+
+	if( !out )
+	{
+		std::cout << "Error opening " << path << " for writing!" << std::endl;
+		return false;
+	}
+
+	out << std::fixed << std::setprecision( 3 );
+	out << "{\"traceEvents\":[\n";
+
+	for( i = 0; i < mRings.size(); i++ )
+	{
+		mRings[i]->copy( 0, mCopy );
+
+		out << ( first ? "" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+		    << ",\"args\":{\"name\":\"" << ( i == 0 ? "main" : "thread " ) << ( i == 0 ? "" : std::to_string( i ) ) << "\"}}";
+		first = false;
+
+		for( auto event = mCopy.begin(); event != mCopy.end(); event++ )
+		{
+			if( event->counter )
+			{
+				out << ",\n{\"name\":\"" << event->name << "\",\"ph\":\"C\",\"ts\":" << event->time / 1000.0
+				    << ",\"pid\":0,\"tid\":" << i << ",\"args\":{\"value\":" << event->value << "}}";
+			}
+			else
+			{
+				out << ",\n{\"name\":\"" << event->name << "\",\"ph\":\"X\",\"ts\":" << event->time / 1000.0
+				    << ",\"dur\":" << event->value / 1000.0 << ",\"pid\":0,\"tid\":" << i << "}";
+			}
+		}
+	}
+
+	out << "\n]}\n";
+
+	return true;
+}
+
+static void addQuad( sf::VertexArray& vertices, sf::FloatRect rect, sf::Color color )
+{
+	vertices.append( sf::Vertex( sf::Vector2f( rect.left, rect.top ), color ) );
+	vertices.append( sf::Vertex( sf::Vector2f( rect.left + rect.width, rect.top ), color ) );
+	vertices.append( sf::Vertex( sf::Vector2f( rect.left + rect.width, rect.top + rect.height ), color ) );
+	vertices.append( sf::Vertex( sf::Vector2f( rect.left, rect.top + rect.height ), color ) );
+}
+
+ProfileOverlay::ProfileOverlay() : mVertices( sf::Quads )
+{
+}
+
+//One row per zone, the bar is the average and the tick the p99. Zones are scaled in milliseconds
+//with a red line at 60fps, counters like draw calls get a few pixels per unit
+void ProfileOverlay::update( const Profiler& profiler )
+{
+	static const sf::Color colors[] = {
+		sf::Color( 230, 90, 70 ), sf::Color( 240, 180, 60 ), sf::Color( 120, 200, 80 ), sf::Color( 70, 170, 220 ),
+		sf::Color( 160, 110, 220 ), sf::Color( 220, 110, 180 ), sf::Color( 90, 210, 190 ), sf::Color( 200, 200, 200 )
+	};
+	const float left = 8.0f, top = 8.0f;
+	size_t i;
+
+	profiler.getStats( mStats );
+	mVertices.clear();
+
+	float height = mStats.size() * ( ROW_HEIGHT + ROW_GAP ) + ROW_GAP;
+
+	addQuad( mVertices, sf::FloatRect( left, top, PANEL_WIDTH, height ), sf::Color( 0, 0, 0, 160 ) );
+
+	for( i = 0; i < mStats.size(); i++ )
+	{
+		float scale = mStats[i].counter ? PIXELS_PER_CALL : PIXELS_PER_MS;
+		float y	    = top + ROW_GAP + i * ( ROW_HEIGHT + ROW_GAP );
+		float bar   = std::min( mStats[i].average * scale, PANEL_WIDTH );
+		float tick  = std::min( mStats[i].p99 * scale, PANEL_WIDTH - 2.0f );
+
+		addQuad( mVertices, sf::FloatRect( left, y, bar, ROW_HEIGHT ), colors[i % 8] );
+		addQuad( mVertices, sf::FloatRect( left + tick, y, 2.0f, ROW_HEIGHT ), sf::Color::White );
+	}
+
+	addQuad( mVertices, sf::FloatRect( left + PIXELS_PER_MS * 1000.0f / 60.0f, top, 1.0f, height ), sf::Color::Red );
+}
+
+void ProfileOverlay::draw( sf::RenderTarget& target, sf::RenderStates states ) const
+{
+	target.draw( mVertices, states );
+}
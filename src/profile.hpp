@@ -0,0 +1,145 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+//One timed zone or counter sample, times are in nanoseconds since the profiler started
+struct ProfileEvent
+{
+	const char	*name;
+	sf::Int64	 time;
+	sf::Int64	 value;
+	bool		 counter;
+};
+
+//Where one thread's events go. Only its own thread writes to it, the oldest events get overwritten
+class ProfileRing
+{
+public:
+	ProfileRing( size_t );
+	void		push( const ProfileEvent& );
+	size_t		copy( size_t, std::vector<ProfileEvent>& ) const;
+	size_t		getThread() const { return mThread; }
+
+private:
+	friend class Profiler;
+
+	std::vector<ProfileEvent>	mEvents;
+	std::atomic<size_t>		mHead;
+	size_t				mThread;
+};
+
+//Per frame cost of a zone, or value of a counter, over the last few seconds
+struct ProfileStats
+{
+	const char	*name;
+	bool		 counter;
+	float		 average;
+	float		 p99;
+};
+
+//Collects the zones every thread records and sums them up per frame
+class Profiler
+{
+public:
+	Profiler();
+	~Profiler();
+	sf::Int64	now() const;
+	void		record( const char *, sf::Int64, sf::Int64 );
+	void		count( const char *, size_t );
+	void		endFrame();
+	void		getStats( std::vector<ProfileStats>& ) const;
+	void		printStats() const;
+	bool		writeTrace( const std::string& ) const;
+	void		releaseRing( ProfileRing * );
+
+private:
+	struct Zone
+	{
+		const char		*name;
+		bool			 counter;
+		float			 frame;
+		std::vector<float>	 history;
+	};
+
+	ProfileRing*	getRing();
+	Zone&		getZone( const char *, bool );
+
+	std::vector<ProfileRing*>	mRings;
+	std::vector<ProfileRing*>	mFreeRings;
+	std::vector<size_t>		mCursors;
+	std::vector<Zone>		mZones;
+	mutable std::vector<ProfileEvent>	mCopy;
+	mutable std::mutex		mMutex;
+	sf::Int64			mEpoch;
+	size_t				mFrames;
+	size_t				mAllocations;
+};
+
+extern Profiler gProfiler;
+
+//Times the scope it's declared in
+class ProfileZone
+{
+public:
+	ProfileZone( const char *name ) : mName( name ), mStart( gProfiler.now() ) {}
+	~ProfileZone() { gProfiler.record( mName, mStart, gProfiler.now() ); }
+
+private:
+	const char	*mName;
+	sf::Int64	 mStart;
+};
+
+//Shows the per frame cost of every zone as bars, since there's no font to write them out with.
+//The rows are in the same order printStats lists them
+class ProfileOverlay : public sf::Drawable
+{
+public:
+	ProfileOverlay();
+	void		update( const Profiler& );
+
+private:
+	virtual void	draw( sf::RenderTarget&, sf::RenderStates ) const;
+
+	sf::VertexArray			mVertices;
+	std::vector<ProfileStats>	mStats;
+};
+
+//Zones are only compiled in with make PROFILE=1, otherwise they're nothing at all
+#ifdef NOZOKI_PROFILE
+#define PROFILE_JOIN2( a, b ) a##b
+#define PROFILE_JOIN( a, b ) PROFILE_JOIN2( a, b )
+#define PROFILE_ZONE( name ) ProfileZone PROFILE_JOIN( profileZone, __LINE__ )( name )
+#define PROFILE_COUNT( name, value ) gProfiler.count( name, value )
+#define PROFILE_END_FRAME() gProfiler.endFrame()
+#else
+#define PROFILE_ZONE( name )
+#define PROFILE_COUNT( name, value )
+#define PROFILE_END_FRAME()
+#endif
+
+#endif
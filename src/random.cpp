@@ -0,0 +1,59 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+
+#include "random.hpp"
+
+//SplitMix64's finaliser, spreads every bit of the input over the whole output
+static sf::Uint64 mix( sf::Uint64 x )
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x  = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+	x  = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebull;
+
+	return x ^ ( x >> 31 );
+}
+
+//The key for stream index of a kind of stream under a seed. Squares wants keys with their bits well
+//spread, so they're hashed, and odd
+sf::Uint64 RandomStream::makeKey( unsigned int seed, sf::Uint32 kind, sf::Uint64 index )
+{
+	return mix( mix( ( (sf::Uint64)seed << 32 ) | kind ) ^ index ) | 1;
+}
+
+//The next count numbers at once. None of them depend on each other so this vectorises
+void RandomStream::fill( sf::Uint32 *out, size_t count )
+{
+	size_t i;
+
+	for( i = 0; i < count; i++ )
+	{
+		out[i] = at( mKey, mCounter + i );
+	}
+
+	mCounter += count;
+}
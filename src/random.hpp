@@ -0,0 +1,76 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+//What a stream of random numbers is for, so streams for different things never line up
+enum {
+	STREAM_DUNGEON_LAYOUT,
+	STREAM_DUNGEON_ROOM,
+	STREAM_CHUNK_ROOM,
+	STREAM_CHUNK_EDGE_EAST,
+	STREAM_CHUNK_EDGE_SOUTH,
+	STREAM_ENTITY
+};
+
+//Counter based random numbers using Widynski's Squares. The nth number of a stream only depends on the
+//stream's key and n, so nothing is shared between streams and any of them can start at any point
+class RandomStream
+{
+public:
+	RandomStream( sf::Uint64 key = 1, sf::Uint64 counter = 0 ) : mKey( key ), mCounter( counter ) {}
+	sf::Uint32 next() { return at( mKey, mCounter++ ); }
+	int nextInt( int low, int high ) { return low + (int)( ( (sf::Uint64)next() * (sf::Uint32)( high - low + 1 ) ) >> 32 ); }
+	float nextFloat() { return ( next() >> 8 ) * ( 1.0f / 16777216.0f ); }
+	void		fill( sf::Uint32 *, size_t );
+	sf::Uint64 getCounter() const { return mCounter; }
+	static sf::Uint64	makeKey( unsigned int, sf::Uint32, sf::Uint64 );
+	static sf::Uint64 packCoord( int x, int y ) { return ( (sf::Uint64)(sf::Uint32)x << 32 ) | (sf::Uint32)y; }
+
+	//Four rounds of squaring the counter times the key and swapping its halves
+	static sf::Uint32 at( sf::Uint64 key, sf::Uint64 counter )
+	{
+		sf::Uint64 x, y, z;
+
+		y = x = counter * key;
+		z = y + key;
+		x = ( x * x ) + y;
+		x = ( x >> 32 ) | ( x << 32 );
+		x = ( x * x ) + z;
+		x = ( x >> 32 ) | ( x << 32 );
+		x = ( x * x ) + y;
+		x = ( x >> 32 ) | ( x << 32 );
+
+		return ( ( x * x ) + z ) >> 32;
+	}
+
+private:
+	sf::Uint64	mKey;
+	sf::Uint64	mCounter;
+};
+
+#endif
@@ -0,0 +1,319 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include "random.hpp"
+#include "clock.hpp"
+#include "input.hpp"
+#include "entity.hpp"
+#include "map.hpp"
+#include "render.hpp"
+
+sf::FloatRect getViewRect( const sf::View& view )
+{
+	return sf::FloatRect( view.getCenter() - ( view.getSize() / 2.0f ), view.getSize() );
+}
+
+SpriteBatch::SpriteBatch()
+{
+	mQuadCount   = 0;
+	mCulledCount = 0;
+	mDrawCalls   = 0;
+}
+
+//Empty the batch for a new frame, the vertex arrays keep their memory
+void SpriteBatch::clear()
+{
+	for( auto it = mBatches.begin(); it != mBatches.end(); it++ )
+	{
+		it->vertices.clear();
+	}
+
+	mQuadCount   = 0;
+	mCulledCount = 0;
+}
+
+//Sprites entirely outside of this rect are dropped by add()
+void SpriteBatch::setCullRect( sf::FloatRect rect )
+{
+	mCullRect = rect;
+}
+
+//Append the sprite's quad to its texture's batch, returns false if it was culled
+bool SpriteBatch::add( const sf::Sprite& sprite )
+{
+	if( sprite.getTexture() == NULL || !mCullRect.intersects( sprite.getGlobalBounds() ) )
+	{
+		mCulledCount++;
+		return false;
+	}
+
+	Batch *batch = NULL;
+
+	for( auto it = mBatches.begin(); it != mBatches.end(); it++ )
+	{
+		if( it->texture == sprite.getTexture() )
+		{
+			batch = &( *it );
+			break;
+		}
+	}
+
+	if( batch == NULL )
+	{
+		mBatches.push_back( Batch() );
+		batch		= &mBatches.back();
+		batch->texture	= sprite.getTexture();
+		batch->vertices.setPrimitiveType( sf::Quads );
+	}
+
+	//Same corners and texture coordinates sf::Sprite would use, so flipped sprites still work
+	const sf::Transform&	transform = sprite.getTransform();
+	sf::IntRect		rect	  = sprite.getTextureRect();
+	float			width	  = std::abs( rect.width );
+	float			height	  = std::abs( rect.height );
+	float			left	  = rect.left;
+	float			right	  = rect.left + rect.width;
+	float			top	  = rect.top;
+	float			bottom	  = rect.top + rect.height;
+
+	batch->vertices.append( sf::Vertex( transform.transformPoint( 0, 0 ), sprite.getColor(), sf::Vector2f( left, top ) ) );
+	batch->vertices.append( sf::Vertex( transform.transformPoint( width, 0 ), sprite.getColor(), sf::Vector2f( right, top ) ) );
+	batch->vertices.append( sf::Vertex( transform.transformPoint( width, height ), sprite.getColor(), sf::Vector2f( right, bottom ) ) );
+	batch->vertices.append( sf::Vertex( transform.transformPoint( 0, height ), sprite.getColor(), sf::Vector2f( left, bottom ) ) );
+
+	mQuadCount++;
+
+	return true;
+}
+
+void SpriteBatch::draw( sf::RenderTarget& target, sf::RenderStates states ) const
+{
+	mDrawCalls = 0;
+
+	for( auto it = mBatches.begin(); it != mBatches.end(); it++ )
+	{
+		if( it->vertices.getVertexCount() != 0 )
+		{
+			states.texture = it->texture;
+			target.draw( it->vertices, states );
+			mDrawCalls++;
+		}
+	}
+}
+
+MapRenderer::MapRenderer( size_t chunkSize )
+{
+	mChunkSize   = chunkSize;
+	mChunksWide  = 0;
+	mChunksHigh  = 0;
+	mTileSize    = 0;
+	mTexture     = NULL;
+	mChunksDrawn = 0;
+}
+
+void MapRenderer::setTexture( const sf::Texture& texture )
+{
+	mTexture = &texture;
+}
+
+//Tiles of a type without a rect are left out of the chunks entirely
+void MapRenderer::setTileRect( sf::Uint8 type, sf::IntRect rect )
+{
+	mTileRects[type] = rect;
+}
+
+//(Re)build the vertices of every chunk from the map's tile data
+void MapRenderer::build( const Map& map )
+{
+	size_t i, j;
+
+	mTileSize   = map.getTileSize();
+	mChunksWide = ( map.getWidth() + mChunkSize - 1 ) / mChunkSize;
+	mChunksHigh = ( map.getHeight() + mChunkSize - 1 ) / mChunkSize;
+
+	mChunks.clear();
+	mChunks.resize( mChunksWide * mChunksHigh, sf::VertexArray( sf::Quads ) );
+
+	for( i = 0; i < mChunksWide; i++ )
+	{
+		for( j = 0; j < mChunksHigh; j++ )
+		{
+			buildChunk( map, i, j );
+		}
+	}
+}
+
+//Fill in one chunk, every tile gets a fixed slot of four vertices so it can be found again later
+void MapRenderer::buildChunk( const Map& map, size_t cx, size_t cy )
+{
+	size_t i, j, x, y;
+	size_t startX = cx * mChunkSize;
+	size_t startY = cy * mChunkSize;
+	size_t w      = std::min( mChunkSize, map.getWidth() - startX );
+	size_t h      = std::min( mChunkSize, map.getHeight() - startY );
+	bool   empty  = true;
+
+	sf::VertexArray& chunk = mChunks[( cy * mChunksWide ) + cx];
+
+	//Chunks without anything to draw take up no memory
+	for( x = startX; x < startX + w && empty; x++ )
+	{
+		for( y = startY; y < startY + h; y++ )
+		{
+			if( mTileRects[map.getTile( x, y )].width != 0 )
+			{
+				empty = false;
+				break;
+			}
+		}
+	}
+
+	if( empty )
+	{
+		chunk.clear();
+		return;
+	}
+
+	chunk.resize( w * h * 4 );
+
+	for( i = 0; i < w; i++ )
+	{
+		for( j = 0; j < h; j++ )
+		{
+			setQuad( &chunk[( ( j * w ) + i ) * 4], map.getTile( startX + i, startY + j ), startX + i, startY + j );
+		}
+	}
+}
+
+//Point a tile's quad at its type's rect, tiles without one get a quad with no size
+void MapRenderer::setQuad( sf::Vertex *quad, sf::Uint8 type, size_t x, size_t y ) const
+{
+	sf::IntRect	rect = mTileRects[type];
+	float		left = x * mTileSize;
+	float		top  = y * mTileSize;
+	float		size = rect.width != 0 ? mTileSize : 0.0f;
+
+	quad[0].position = sf::Vector2f( left, top );
+	quad[1].position = sf::Vector2f( left + size, top );
+	quad[2].position = sf::Vector2f( left + size, top + size );
+	quad[3].position = sf::Vector2f( left, top + size );
+
+	quad[0].texCoords = sf::Vector2f( rect.left, rect.top );
+	quad[1].texCoords = sf::Vector2f( rect.left + rect.width, rect.top );
+	quad[2].texCoords = sf::Vector2f( rect.left + rect.width, rect.top + rect.height );
+	quad[3].texCoords = sf::Vector2f( rect.left, rect.top + rect.height );
+}
+
+//Rewrite just the quads of the tiles the map has marked dirty since it was built. A chunk that was empty
+//has no slots to write to, so that one is built over again
+void MapRenderer::update( const Map& map )
+{
+	const std::vector<sf::IntRect>& dirty = map.getDirtyRects();
+
+	if( mChunks.empty() )
+	{
+		return;
+	}
+
+	for( auto it = dirty.begin(); it != dirty.end(); it++ )
+	{
+		size_t left   = std::max( 0, it->left );
+		size_t top    = std::max( 0, it->top );
+		size_t right  = std::min( (int)map.getWidth(), it->left + it->width );
+		size_t bottom = std::min( (int)map.getHeight(), it->top + it->height );
+		size_t cx, cy, x, y;
+
+		if( left >= right || top >= bottom )
+		{
+			continue;
+		}
+
+		for( cy = top / mChunkSize; cy <= ( bottom - 1 ) / mChunkSize; cy++ )
+		{
+			for( cx = left / mChunkSize; cx <= ( right - 1 ) / mChunkSize; cx++ )
+			{
+				sf::VertexArray& chunk	= mChunks[( cy * mChunksWide ) + cx];
+				size_t		 startX = cx * mChunkSize;
+				size_t		 startY = cy * mChunkSize;
+				size_t		 w	= std::min( mChunkSize, map.getWidth() - startX );
+
+				if( chunk.getVertexCount() == 0 )
+				{
+					buildChunk( map, cx, cy );
+					continue;
+				}
+
+				for( y = std::max( top, startY ); y < std::min( bottom, startY + mChunkSize ); y++ )
+				{
+					for( x = std::max( left, startX ); x < std::min( right, startX + mChunkSize ); x++ )
+					{
+						setQuad( &chunk[( ( ( y - startY ) * w ) + ( x - startX ) ) * 4], map.getTile( x, y ), x, y );
+					}
+				}
+			}
+		}
+	}
+}
+
+//Only draw the chunks that overlap the target's current view
+void MapRenderer::draw( sf::RenderTarget& target, sf::RenderStates states ) const
+{
+	int i, j;
+	const sf::View& view = target.getView();
+
+	float	chunkPixels = mChunkSize * mTileSize;
+	float	left	    = view.getCenter().x - ( view.getSize().x / 2 );
+	float	top	    = view.getCenter().y - ( view.getSize().y / 2 );
+	int	firstX	    = std::max( 0, (int)std::floor( left / chunkPixels ) );
+	int	firstY	    = std::max( 0, (int)std::floor( top / chunkPixels ) );
+	int	lastX	    = std::min( (int)mChunksWide - 1, (int)std::floor( ( left + view.getSize().x ) / chunkPixels ) );
+	int	lastY	    = std::min( (int)mChunksHigh - 1, (int)std::floor( ( top + view.getSize().y ) / chunkPixels ) );
+
+	states.texture = mTexture;
+	mChunksDrawn   = 0;
+
+	for( i = firstX; i <= lastX; i++ )
+	{
+		for( j = firstY; j <= lastY; j++ )
+		{
+			const sf::VertexArray& chunk = mChunks[( j * mChunksWide ) + i];
+
+			if( chunk.getVertexCount() != 0 )
+			{
+				target.draw( chunk, states );
+				mChunksDrawn++;
+			}
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef RENDER_HPP
+#define RENDER_HPP
+
+//Get the area of the world a view is looking at
+sf::FloatRect getViewRect( const sf::View& );
+
+//Draws a map as fixed-size chunks of tiles, skipping chunks outside the current view
+class MapRenderer : public sf::Drawable
+{
+public:
+	MapRenderer( size_t = 16 );
+	void		setTexture( const sf::Texture& );
+	void		setTileRect( sf::Uint8, sf::IntRect );
+	void		build( const Map& );
+	void		update( const Map& );
+	size_t		getChunksDrawn() const { return mChunksDrawn; }
+
+private:
+	virtual void	draw( sf::RenderTarget&, sf::RenderStates ) const;
+	void		buildChunk( const Map&, size_t, size_t );
+	void		setQuad( sf::Vertex *, sf::Uint8, size_t, size_t ) const;
+
+	size_t				 mChunkSize;
+	size_t				 mChunksWide;
+	size_t				 mChunksHigh;
+	size_t				 mTileSize;
+	const sf::Texture		*mTexture;
+	sf::IntRect			 mTileRects[256];
+	std::vector<sf::VertexArray>	 mChunks;
+	mutable size_t			 mChunksDrawn;
+};
+
+//Collects sprites into one vertex array per texture so each texture is a single draw call
+class SpriteBatch : public sf::Drawable
+{
+public:
+	SpriteBatch();
+	void	clear();
+	void	setCullRect( sf::FloatRect );
+	bool	add( const sf::Sprite& );
+	size_t getDrawCalls() const { return mDrawCalls; }
+	size_t getQuadCount() const { return mQuadCount; }
+	size_t getCulledCount() const { return mCulledCount; }
+
+private:
+	struct Batch
+	{
+		const sf::Texture	*texture;
+		sf::VertexArray		 vertices;
+	};
+
+	virtual void draw( sf::RenderTarget&, sf::RenderStates ) const;
+
+	std::vector<Batch>	mBatches;
+	sf::FloatRect		mCullRect;
+	size_t			mQuadCount;
+	size_t			mCulledCount;
+	mutable size_t		mDrawCalls;
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+#include <iostream>
+#include <string>
+#include <map>
+
+#include "resource.hpp"
+
+ResourceCache gResources;
+
+ResourceCache::ResourceCache()
+{
+	mLoadCount   = 0;
+	mHitCount    = 0;
+	mMemoryUsage = 0;
+}
+
+//Return the texture for a file, decoding and uploading it only the first time it's asked for
+const sf::Texture& ResourceCache::getTexture( const std::string& path )
+{
+	auto it = mTextures.find( path );
+
+	if( it != mTextures.end() )
+	{
+		mHitCount++;
+		return it->second;
+	}
+
+	sf::Clock	 clock;
+	sf::Texture&	 texture = mTextures[path];
+
+	//A failed load still gets cached so we don't retry it for every caller
+	if( !texture.loadFromFile( path ) )
+	{
+		std::cout << "Error loading texture from " << path << "!" << std::endl;
+	}
+
+	mLoadTime    += clock.getElapsedTime();
+	mMemoryUsage += texture.getSize().x * texture.getSize().y * 4;
+	mLoadCount++;
+
+	return texture;
+}
+
+//Upload an image that was already decoded, off the main thread say, as the texture for a file.
+//If the file is already cached that texture is kept, sprites may be pointing at it
+const sf::Texture& ResourceCache::addTexture( const std::string& path, const sf::Image& image )
+{
+	auto it = mTextures.find( path );
+
+	if( it != mTextures.end() )
+	{
+		mHitCount++;
+		return it->second;
+	}
+
+	sf::Clock	 clock;
+	sf::Texture&	 texture = mTextures[path];
+
+	if( !texture.loadFromImage( image ) )
+	{
+		std::cout << "Error uploading texture for " << path << "!" << std::endl;
+	}
+
+	mLoadTime    += clock.getElapsedTime();
+	mMemoryUsage += texture.getSize().x * texture.getSize().y * 4;
+	mLoadCount++;
+
+	return texture;
+}
+
+//A sprite showing part of a shared texture
+sf::Sprite ResourceCache::getSprite( const std::string& path, sf::IntRect rect )
+{
+	return sf::Sprite( getTexture( path ), rect );
+}
+
+void ResourceCache::printStats()
+{
+	std::cout << "Resources: " << mLoadCount << " textures loaded in "
+		  << mLoadTime.asMilliseconds() << "ms, "
+		  << mHitCount << " cache hits, "
+		  << ( mMemoryUsage / 1024 ) << "KB of texture memory" << std::endl;
+}
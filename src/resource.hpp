@@ -0,0 +1,54 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef RESOURCE_HPP
+#define RESOURCE_HPP
+
+//Loads each texture once and hands out sprites that share it
+class ResourceCache
+{
+public:
+	ResourceCache();
+	const sf::Texture&	getTexture( const std::string& );
+	const sf::Texture&	addTexture( const std::string&, const sf::Image& );
+	sf::Sprite		getSprite( const std::string&, sf::IntRect );
+	void			printStats();
+	size_t getLoadCount() { return mLoadCount; }
+	size_t getHitCount() { return mHitCount; }
+	size_t getMemoryUsage() { return mMemoryUsage; }
+	sf::Time getLoadTime() { return mLoadTime; }
+
+private:
+	std::map<std::string, sf::Texture>	mTextures;
+	size_t					mLoadCount;
+	size_t					mHitCount;
+	size_t					mMemoryUsage;
+	sf::Time				mLoadTime;
+};
+
+extern ResourceCache gResources;
+
+#endif
@@ -0,0 +1,550 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+
+#include "random.hpp"
+#include "map.hpp"
+#include "room.hpp"
+
+//Steps for each direction, in tiles
+static const int gStepX[4] = { 1, -1, 0, 0 };
+static const int gStepY[4] = { 0, 0, -1, 1 };
+
+static sf::Uint32 getManhattan( sf::Vector2i a, sf::Vector2i b )
+{
+	return std::abs( a.x - b.x ) + std::abs( a.y - b.y );
+}
+
+const size_t RoomGraph::NO_AREA;
+const size_t RoomGraph::CELL_SIZE;
+const size_t RoomPathfinder::NO_NODE;
+const sf::Uint32 RoomPathfinder::NO_COST;
+
+RoomGraph::RoomGraph()
+{
+	mWidth	   = 0;
+	mHeight	   = 0;
+	mCellsWide = 0;
+	mCellsHigh = 0;
+}
+
+void RoomGraph::clear()
+{
+	mAreas.clear();
+	mPortals.clear();
+	mCellStart.clear();
+	mCellAreas.clear();
+	mNodeStart.clear();
+	mNodes.clear();
+}
+
+size_t RoomGraph::addArea( sf::IntRect rect, sf::Uint32 kind, size_t enemyCount )
+{
+	RoomArea area = { rect, kind, (sf::Uint32)enemyCount };
+
+	mAreas.push_back( area );
+
+	return mAreas.size() - 1;
+}
+
+//Join two areas at the middle of the edge they share, returns false if they don't share one
+bool RoomGraph::addPortal( size_t a, size_t b )
+{
+	const sf::IntRect& first  = mAreas[a].rect;
+	const sf::IntRect& second = mAreas[b].rect;
+	RoomPortal	   portal;
+	int		   low, high;
+
+	portal.areas[0] = a;
+	portal.areas[1] = b;
+
+	if( first.left + first.width == second.left || second.left + second.width == first.left )
+	{
+		low  = std::max( first.top, second.top );
+		high = std::min( first.top + first.height, second.top + second.height );
+
+		int x = first.left + first.width == second.left ? second.left : first.left;
+
+		portal.tiles[0] = sf::Vector2i( x == second.left ? x - 1 : x, low + ( ( high - low ) / 2 ) );
+		portal.tiles[1] = sf::Vector2i( x == second.left ? x : x - 1, low + ( ( high - low ) / 2 ) );
+	}
+	else if( first.top + first.height == second.top || second.top + second.height == first.top )
+	{
+		low  = std::max( first.left, second.left );
+		high = std::min( first.left + first.width, second.left + second.width );
+
+		int y = first.top + first.height == second.top ? second.top : first.top;
+
+		portal.tiles[0] = sf::Vector2i( low + ( ( high - low ) / 2 ), y == second.top ? y - 1 : y );
+		portal.tiles[1] = sf::Vector2i( low + ( ( high - low ) / 2 ), y == second.top ? y : y - 1 );
+	}
+	else
+	{
+		return false;
+	}
+
+	if( low >= high )
+	{
+		return false;
+	}
+
+	mPortals.push_back( portal );
+
+	return true;
+}
+
+//Take areas and portals from somewhere else, like a level file. Needs building afterwards
+void RoomGraph::assign( const RoomArea *areas, size_t areaCount, const RoomPortal *portals, size_t portalCount )
+{
+	clear();
+	mAreas.assign( areas, areas + areaCount );
+	mPortals.assign( portals, portals + portalCount );
+}
+
+//The cells a rectangle of tiles overlaps, as a rectangle of cells. False if it's off the map
+bool RoomGraph::getCells( sf::IntRect rect, sf::IntRect& cells ) const
+{
+	int right  = std::min( rect.left + rect.width, (int)mWidth );
+	int bottom = std::min( rect.top + rect.height, (int)mHeight );
+	int left   = std::max( rect.left, 0 );
+	int top	   = std::max( rect.top, 0 );
+
+	if( left >= right || top >= bottom )
+	{
+		return false;
+	}
+
+	cells.left   = left / CELL_SIZE;
+	cells.top    = top / CELL_SIZE;
+	cells.width  = ( ( right - 1 ) / CELL_SIZE ) - cells.left + 1;
+	cells.height = ( ( bottom - 1 ) / CELL_SIZE ) - cells.top + 1;
+
+	return true;
+}
+
+//Sort the areas into cells and the portal sides into the areas they're in, once all of them are added.
+//Both are counted first and then filled in, so each ends up in one flat array
+void RoomGraph::build( size_t w, size_t h )
+{
+	sf::IntRect cells;
+	size_t	    i;
+	int	    x, y;
+
+	mWidth	   = w;
+	mHeight	   = h;
+	mCellsWide = ( w + CELL_SIZE - 1 ) / CELL_SIZE;
+	mCellsHigh = ( h + CELL_SIZE - 1 ) / CELL_SIZE;
+	mCellStart.assign( ( mCellsWide * mCellsHigh ) + 1, 0 );
+
+	for( i = 0; i < mAreas.size(); i++ )
+	{
+		if( getCells( mAreas[i].rect, cells ) )
+		{
+			for( y = cells.top; y < cells.top + cells.height; y++ )
+			{
+				for( x = cells.left; x < cells.left + cells.width; x++ )
+				{
+					mCellStart[( y * mCellsWide ) + x + 1]++;
+				}
+			}
+		}
+	}
+
+	for( i = 0; i < mCellsWide * mCellsHigh; i++ )
+	{
+		mCellStart[i + 1] += mCellStart[i];
+	}
+
+	std::vector<size_t> next( mCellStart.begin(), mCellStart.end() - 1 );
+	mCellAreas.resize( mCellStart.back() );
+
+	for( i = 0; i < mAreas.size(); i++ )
+	{
+		if( getCells( mAreas[i].rect, cells ) )
+		{
+			for( y = cells.top; y < cells.top + cells.height; y++ )
+			{
+				for( x = cells.left; x < cells.left + cells.width; x++ )
+				{
+					mCellAreas[next[( y * mCellsWide ) + x]++] = i;
+				}
+			}
+		}
+	}
+
+	//Then the portal sides by the area they're in
+	mNodeStart.assign( mAreas.size() + 1, 0 );
+	mNodes.resize( mPortals.size() * 2 );
+
+	for( i = 0; i < mPortals.size() * 2; i++ )
+	{
+		mNodeStart[getNodeArea( i ) + 1]++;
+	}
+
+	for( i = 0; i < mAreas.size(); i++ )
+	{
+		mNodeStart[i + 1] += mNodeStart[i];
+	}
+
+	next.assign( mNodeStart.begin(), mNodeStart.end() - 1 );
+
+	for( i = 0; i < mPortals.size() * 2; i++ )
+	{
+		mNodes[next[getNodeArea( i )]++] = i;
+	}
+}
+
+//The area a tile is in, NO_AREA if it's outside all of them
+size_t RoomGraph::findArea( sf::Vector2i tile ) const
+{
+	if( tile.x < 0 || tile.y < 0 || tile.x >= (int)mWidth || tile.y >= (int)mHeight )
+	{
+		return NO_AREA;
+	}
+
+	size_t cell = ( ( tile.y / CELL_SIZE ) * mCellsWide ) + ( tile.x / CELL_SIZE );
+	size_t i;
+
+	for( i = mCellStart[cell]; i < mCellStart[cell + 1]; i++ )
+	{
+		if( mAreas[mCellAreas[i]].rect.contains( tile ) )
+		{
+			return mCellAreas[i];
+		}
+	}
+
+	return NO_AREA;
+}
+
+RoomPathfinder::RoomPathfinder()
+{
+	mWidth	  = 0;
+	mHeight	  = 0;
+	mExpanded = 0;
+	mSearch	  = 0;
+}
+
+void RoomPathfinder::resize( const Map& map )
+{
+	mWidth	= map.getWidth();
+	mHeight = map.getHeight();
+	mSearch = 0;
+
+	mSeen.assign( mWidth * mHeight, 0 );
+	mCost.assign( mWidth * mHeight, 0 );
+	mFrom.assign( mWidth * mHeight, 0 );
+}
+
+//Path between two tiles, both ends included. Plans from portal to portal and then walks each area
+//it crosses. Fails if either end isn't in an area or the tiles changed since the graph was made so
+//an area can't be walked across any more, a grid search over the whole map can still be used then
+bool RoomPathfinder::findPath( const Map& map, const RoomGraph& graph, sf::Vector2i from, sf::Vector2i to, std::vector<sf::Vector2i>& path )
+{
+	size_t fromArea = graph.findArea( from );
+	size_t toArea	= graph.findArea( to );
+	size_t i;
+
+	mExpanded = 0;
+	path.clear();
+
+	if( fromArea == RoomGraph::NO_AREA || toArea == RoomGraph::NO_AREA )
+	{
+		return false;
+	}
+
+	//Areas are rectangles, nothing is shorter than going straight across
+	if( fromArea == toArea )
+	{
+		return search( map, graph.getAreas()[fromArea].rect, from, to, path );
+	}
+
+	if( !planRoute( graph, from, fromArea, to, toArea ) )
+	{
+		return false;
+	}
+
+	sf::Vector2i tile = from;
+	size_t	     area = fromArea;
+
+	path.push_back( from );
+
+	//The route alternates between walking across an area to a portal and stepping through it
+	for( i = 0; i < mRoute.size(); i++ )
+	{
+		size_t	     node = mRoute[i];
+		sf::Vector2i next = node == NO_NODE ? to : graph.getNodeTile( node );
+
+		if( i > 0 && mRoute[i - 1] != NO_NODE && node != NO_NODE && node == ( mRoute[i - 1] ^ 1 ) )
+		{
+			path.push_back( next );
+			area = graph.getNodeArea( node );
+		}
+		else
+		{
+			if( !search( map, graph.getAreas()[area].rect, tile, next, mSegment ) )
+			{
+				path.clear();
+				return false;
+			}
+
+			path.insert( path.end(), mSegment.begin() + 1, mSegment.end() );
+		}
+
+		tile = next;
+	}
+
+	return true;
+}
+
+//Path between two tiles that doesn't leave bounds, both ends included
+bool RoomPathfinder::findGridPath( const Map& map, sf::IntRect bounds, sf::Vector2i from, sf::Vector2i to, std::vector<sf::Vector2i>& path )
+{
+	mExpanded = 0;
+
+	return search( map, bounds, from, to, path );
+}
+
+//A* over the tiles inside bounds. Tiles are marked with the search that reached them rather than cleared,
+//so a small search doesn't pay for the size of the map
+bool RoomPathfinder::search( const Map& map, sf::IntRect bounds, sf::Vector2i from, sf::Vector2i to, std::vector<sf::Vector2i>& path )
+{
+	int d;
+
+	path.clear();
+
+	if( mWidth != map.getWidth() || mHeight != map.getHeight() )
+	{
+		resize( map );
+	}
+
+	bounds.width  = std::min( bounds.left + bounds.width, (int)mWidth ) - std::max( bounds.left, 0 );
+	bounds.height = std::min( bounds.top + bounds.height, (int)mHeight ) - std::max( bounds.top, 0 );
+	bounds.left   = std::max( bounds.left, 0 );
+	bounds.top    = std::max( bounds.top, 0 );
+
+	if( !bounds.contains( from ) || !bounds.contains( to ) || !map.isWalkable( from.x, from.y ) || !map.isWalkable( to.x, to.y ) )
+	{
+		return false;
+	}
+
+	if( ++mSearch == 0 )
+	{
+		std::fill( mSeen.begin(), mSeen.end(), 0 );
+		mSearch = 1;
+	}
+
+	size_t start = ( from.y * mWidth ) + from.x;
+	size_t goal  = ( to.y * mWidth ) + to.x;
+
+	mSeen[start] = mSearch;
+	mCost[start] = 0;
+	mOpen.clear();
+	mOpen.push_back( OpenEntry( getManhattan( from, to ), start ) );
+
+	while( !mOpen.empty() )
+	{
+		std::pop_heap( mOpen.begin(), mOpen.end(), std::greater<OpenEntry>() );
+		OpenEntry entry = mOpen.back();
+		mOpen.pop_back();
+
+		size_t	     index = entry.second;
+		sf::Vector2i tile( index % mWidth, index / mWidth );
+
+		//Stale entry for a tile that was reached more cheaply since
+		if( entry.first != mCost[index] + getManhattan( tile, to ) )
+		{
+			continue;
+		}
+
+		mExpanded++;
+
+		if( index == goal )
+		{
+			break;
+		}
+
+		for( d = 0; d < 4; d++ )
+		{
+			sf::Vector2i next( tile.x + gStepX[d], tile.y + gStepY[d] );
+
+			if( !bounds.contains( next ) || !map.isWalkable( next.x, next.y ) )
+			{
+				continue;
+			}
+
+			size_t	   nextIndex = ( next.y * mWidth ) + next.x;
+			sf::Uint32 cost	     = mCost[index] + 1;
+
+			if( mSeen[nextIndex] == mSearch && mCost[nextIndex] <= cost )
+			{
+				continue;
+			}
+
+			mSeen[nextIndex] = mSearch;
+			mCost[nextIndex] = cost;
+			mFrom[nextIndex] = d;
+			mOpen.push_back( OpenEntry( cost + getManhattan( next, to ), nextIndex ) );
+			std::push_heap( mOpen.begin(), mOpen.end(), std::greater<OpenEntry>() );
+		}
+	}
+
+	if( mSeen[goal] != mSearch )
+	{
+		return false;
+	}
+
+	//Walk back from the goal the way each tile was reached
+	for( sf::Vector2i tile = to; tile != from; )
+	{
+		path.push_back( tile );
+		d = mFrom[( tile.y * mWidth ) + tile.x];
+		tile.x -= gStepX[d];
+		tile.y -= gStepY[d];
+	}
+
+	path.push_back( from );
+	std::reverse( path.begin(), path.end() );
+
+	return true;
+}
+
+//A* over the portal sides, leaving the nodes to go through in mRoute with NO_NODE for the goal.
+//Crossing an area is costed as if it were all floor, which it was when the graph was made
+bool RoomPathfinder::planRoute( const RoomGraph& graph, sf::Vector2i from, size_t fromArea, sf::Vector2i to, size_t toArea )
+{
+	size_t nodeCount = graph.getPortals().size() * 2;
+	size_t startNode = nodeCount;
+	size_t goalNode	 = nodeCount + 1;
+	size_t i;
+
+	mNodeCost.assign( nodeCount + 2, NO_COST );
+	mNodeFrom.assign( nodeCount + 2, NO_NODE );
+	mOpen.clear();
+	mRoute.clear();
+
+	mNodeCost[startNode] = 0;
+	mOpen.push_back( OpenEntry( getManhattan( from, to ), startNode ) );
+
+	while( !mOpen.empty() )
+	{
+		std::pop_heap( mOpen.begin(), mOpen.end(), std::greater<OpenEntry>() );
+		OpenEntry entry = mOpen.back();
+		mOpen.pop_back();
+
+		size_t node = entry.second;
+
+		if( node == goalNode )
+		{
+			break;
+		}
+
+		sf::Vector2i tile = node == startNode ? from : graph.getNodeTile( node );
+		size_t	     area = node == startNode ? fromArea : graph.getNodeArea( node );
+
+		if( entry.first != mNodeCost[node] + getManhattan( tile, to ) )
+		{
+			continue;
+		}
+
+		//Everything reachable from here: across the area to its other portals or the goal, or through this portal
+		const size_t *nodes = graph.getNodes( area );
+		size_t	      count = graph.getNodeCount( area );
+
+		for( i = 0; i <= count + 1; i++ )
+		{
+			size_t	     next;
+			sf::Uint32   step;
+			sf::Vector2i nextTile;
+
+			if( i < count )
+			{
+				next	 = nodes[i];
+				nextTile = graph.getNodeTile( next );
+				step	 = getManhattan( tile, nextTile );
+
+				if( next == node )
+				{
+					continue;
+				}
+			}
+			else if( i == count )
+			{
+				if( area != toArea )
+				{
+					continue;
+				}
+
+				next	 = goalNode;
+				nextTile = to;
+				step	 = getManhattan( tile, to );
+			}
+			else
+			{
+				if( node == startNode )
+				{
+					continue;
+				}
+
+				next	 = node ^ 1;
+				nextTile = graph.getNodeTile( next );
+				step	 = 1;
+			}
+
+			sf::Uint32 cost = mNodeCost[node] + step;
+
+			if( cost >= mNodeCost[next] )
+			{
+				continue;
+			}
+
+			mNodeCost[next] = cost;
+			mNodeFrom[next] = node;
+			mOpen.push_back( OpenEntry( cost + getManhattan( nextTile, to ), next ) );
+			std::push_heap( mOpen.begin(), mOpen.end(), std::greater<OpenEntry>() );
+		}
+	}
+
+	if( mNodeCost[goalNode] == NO_COST )
+	{
+		return false;
+	}
+
+	for( i = mNodeFrom[goalNode]; i != startNode; i = mNodeFrom[i] )
+	{
+		mRoute.push_back( i );
+	}
+
+	std::reverse( mRoute.begin(), mRoute.end() );
+	mRoute.push_back( NO_NODE );
+
+	return true;
+}
@@ -0,0 +1,127 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef ROOM_HPP
+#define ROOM_HPP
+
+enum {
+	AREA_ROOM,
+	AREA_SPAWN_ROOM,
+	AREA_HALLWAY
+};
+
+//A room or hallway the generator carved, all of it floor when it was made. Kept the same way in
+//level files as in memory
+struct RoomArea
+{
+	sf::IntRect	rect;
+	sf::Uint32	kind;
+	sf::Uint32	enemyCount;
+};
+
+//Where two areas touch, as the tile either side of the middle of the edge they share
+struct RoomPortal
+{
+	sf::Uint32	areas[2];
+	sf::Vector2i	tiles[2];
+};
+
+//The rooms and hallways of a dungeon and the portals joining them. Every side of a portal is a node
+//for planning over, listed with the area it's in so a search can hop between them
+class RoomGraph
+{
+public:
+	RoomGraph();
+	void		clear();
+	size_t		addArea( sf::IntRect, sf::Uint32, size_t );
+	bool		addPortal( size_t, size_t );
+	void		assign( const RoomArea *, size_t, const RoomPortal *, size_t );
+	void		build( size_t, size_t );
+	size_t		findArea( sf::Vector2i ) const;
+	const std::vector<RoomArea>& getAreas() const { return mAreas; }
+	const std::vector<RoomPortal>& getPortals() const { return mPortals; }
+	const size_t* getNodes( size_t area ) const { return mNodes.data() + mNodeStart[area]; }
+	size_t getNodeCount( size_t area ) const { return mNodeStart[area + 1] - mNodeStart[area]; }
+	sf::Vector2i getNodeTile( size_t node ) const { return mPortals[node / 2].tiles[node % 2]; }
+	size_t getNodeArea( size_t node ) const { return mPortals[node / 2].areas[node % 2]; }
+	bool empty() const { return mAreas.empty(); }
+
+	static const size_t NO_AREA = (size_t)-1;
+
+	//Areas are found through a grid of cells this many tiles across, each listing the areas overlapping it
+	static const size_t CELL_SIZE = 16;
+
+private:
+	bool		getCells( sf::IntRect, sf::IntRect& ) const;
+
+	size_t				mWidth;
+	size_t				mHeight;
+	size_t				mCellsWide;
+	size_t				mCellsHigh;
+	std::vector<RoomArea>		mAreas;
+	std::vector<RoomPortal>		mPortals;
+	std::vector<size_t>		mCellStart;
+	std::vector<size_t>		mCellAreas;
+	std::vector<size_t>		mNodeStart;
+	std::vector<size_t>		mNodes;
+};
+
+//Plans a path over the portals of a room graph first and then fills it in tile by tile only inside
+//the areas along the way, so a long path costs a small part of searching the whole map. Keeps its
+//search space between calls, so each thread wants its own
+class RoomPathfinder
+{
+public:
+	RoomPathfinder();
+	bool		findPath( const Map&, const RoomGraph&, sf::Vector2i, sf::Vector2i, std::vector<sf::Vector2i>& );
+	bool		findGridPath( const Map&, sf::IntRect, sf::Vector2i, sf::Vector2i, std::vector<sf::Vector2i>& );
+	size_t getExpandedCount() const { return mExpanded; }
+
+	static const size_t	NO_NODE = (size_t)-1;
+	static const sf::Uint32	NO_COST = 0xffffffff;
+
+private:
+	typedef std::pair<sf::Uint32, sf::Uint32> OpenEntry;
+
+	void		resize( const Map& );
+	bool		search( const Map&, sf::IntRect, sf::Vector2i, sf::Vector2i, std::vector<sf::Vector2i>& );
+	bool		planRoute( const RoomGraph&, sf::Vector2i, size_t, sf::Vector2i, size_t );
+
+	size_t				mWidth;
+	size_t				mHeight;
+	size_t				mExpanded;
+	sf::Uint32			mSearch;
+	std::vector<sf::Uint32>		mSeen;
+	std::vector<sf::Uint32>		mCost;
+	std::vector<sf::Int8>		mFrom;
+	std::vector<OpenEntry>		mOpen;
+	std::vector<sf::Uint32>		mNodeCost;
+	std::vector<size_t>		mNodeFrom;
+	std::vector<size_t>		mRoute;
+	std::vector<sf::Vector2i>	mSegment;
+};
+
+#endif
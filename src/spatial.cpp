@@ -0,0 +1,201 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+#include "random.hpp"
+#include "map.hpp"
+#include "spatial.hpp"
+
+static const size_t NO_CELL = (size_t)-1;
+
+//Room every bucket starts with, so entities wandering into cells that have been empty so far don't allocate
+static const size_t BUCKET_RESERVE = 4;
+
+//Cells are cellTiles by cellTiles map tiles
+SpatialHash::SpatialHash( size_t cellTiles )
+{
+	mCellTiles = cellTiles;
+	mCellSize  = 0;
+	mCellsWide = 0;
+	mCellsHigh = 0;
+	mMargin	   = 0.0f;
+}
+
+//Lay the grid out over a map, forgetting everything that was in it
+void SpatialHash::resize( Map& map )
+{
+	mCellSize  = mCellTiles * map.getTileSize();
+	mCellsWide = ( map.getWidth() + mCellTiles - 1 ) / mCellTiles;
+	mCellsHigh = ( map.getHeight() + mCellTiles - 1 ) / mCellTiles;
+
+	//Entities are bucketed by their top left corner and are at most a tile big
+	mMargin = map.getTileSize();
+
+	mCells.clear();
+	mCells.resize( mCellsWide * mCellsHigh );
+
+	for( auto it = mCells.begin(); it != mCells.end(); it++ )
+	{
+		it->reserve( BUCKET_RESERVE );
+	}
+	mPositions.clear();
+	mEntityCell.clear();
+	mEntitySlot.clear();
+}
+
+void SpatialHash::clear()
+{
+	for( auto it = mCells.begin(); it != mCells.end(); it++ )
+	{
+		it->clear();
+	}
+
+	mPositions.clear();
+	mEntityCell.clear();
+	mEntitySlot.clear();
+}
+
+size_t SpatialHash::getCell( sf::Vector2f position ) const
+{
+	int x = std::min( std::max( (int)std::floor( position.x / mCellSize ), 0 ), (int)mCellsWide - 1 );
+	int y = std::min( std::max( (int)std::floor( position.y / mCellSize ), 0 ), (int)mCellsHigh - 1 );
+
+	return ( y * mCellsWide ) + x;
+}
+
+//The inclusive range of cells that can hold entities overlapping rect
+void SpatialHash::getCellRange( sf::FloatRect rect, size_t& firstX, size_t& firstY, size_t& lastX, size_t& lastY ) const
+{
+	firstX = std::min( std::max( (int)std::floor( ( rect.left - mMargin ) / mCellSize ), 0 ), (int)mCellsWide - 1 );
+	firstY = std::min( std::max( (int)std::floor( ( rect.top - mMargin ) / mCellSize ), 0 ), (int)mCellsHigh - 1 );
+	lastX  = std::min( std::max( (int)std::floor( ( rect.left + rect.width ) / mCellSize ), 0 ), (int)mCellsWide - 1 );
+	lastY  = std::min( std::max( (int)std::floor( ( rect.top + rect.height ) / mCellSize ), 0 ), (int)mCellsHigh - 1 );
+}
+
+//Insert an entity or move it to the cell for its new position, only touching the buckets if the cell changed
+void SpatialHash::update( size_t id, sf::Vector2f position )
+{
+	if( id >= mEntityCell.size() )
+	{
+		mPositions.resize( id + 1 );
+		mEntityCell.resize( id + 1, NO_CELL );
+		mEntitySlot.resize( id + 1, 0 );
+	}
+
+	size_t cell = getCell( position );
+
+	mPositions[id] = position;
+
+	if( mEntityCell[id] == cell )
+	{
+		return;
+	}
+
+	remove( id );
+
+	mEntityCell[id] = cell;
+	mEntitySlot[id] = mCells[cell].size();
+	mCells[cell].push_back( id );
+}
+
+//Take an entity out of its bucket by swapping the bucket's last entry into its slot
+void SpatialHash::remove( size_t id )
+{
+	if( id >= mEntityCell.size() || mEntityCell[id] == NO_CELL )
+	{
+		return;
+	}
+
+	std::vector<size_t>&	bucket = mCells[mEntityCell[id]];
+	size_t			moved  = bucket.back();
+
+	bucket[mEntitySlot[id]] = moved;
+	mEntitySlot[moved]	= mEntitySlot[id];
+	bucket.pop_back();
+
+	mEntityCell[id] = NO_CELL;
+}
+
+//Append the ids of every entity whose tile-sized box overlaps rect
+void SpatialHash::queryAABB( sf::FloatRect rect, std::vector<size_t>& out ) const
+{
+	size_t i, j, firstX, firstY, lastX, lastY;
+
+	getCellRange( rect, firstX, firstY, lastX, lastY );
+
+	for( j = firstY; j <= lastY; j++ )
+	{
+		for( i = firstX; i <= lastX; i++ )
+		{
+			const std::vector<size_t>& bucket = mCells[( j * mCellsWide ) + i];
+
+			for( auto it = bucket.begin(); it != bucket.end(); it++ )
+			{
+				sf::Vector2f position = mPositions[*it];
+
+				if( position.x + mMargin > rect.left && position.x < rect.left + rect.width &&
+				    position.y + mMargin > rect.top && position.y < rect.top + rect.height )
+				{
+					out.push_back( *it );
+				}
+			}
+		}
+	}
+}
+
+//Append the ids of every entity whose position is within radius of center
+void SpatialHash::queryRadius( sf::Vector2f center, float radius, std::vector<size_t>& out ) const
+{
+	size_t i, j, firstX, firstY, lastX, lastY;
+	float  radiusSq = radius * radius;
+
+	getCellRange( sf::FloatRect( center.x - radius, center.y - radius, radius * 2, radius * 2 ), firstX, firstY, lastX, lastY );
+
+	for( j = firstY; j <= lastY; j++ )
+	{
+		for( i = firstX; i <= lastX; i++ )
+		{
+			const std::vector<size_t>& bucket = mCells[( j * mCellsWide ) + i];
+
+			for( auto it = bucket.begin(); it != bucket.end(); it++ )
+			{
+				sf::Vector2f offset = mPositions[*it] - center;
+
+				if( ( offset.x * offset.x ) + ( offset.y * offset.y ) <= radiusSq )
+				{
+					out.push_back( *it );
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,58 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef SPATIAL_HPP
+#define SPATIAL_HPP
+
+//Uniform grid over a map's tiles that buckets entity ids by the cell their position is in
+class SpatialHash
+{
+public:
+	SpatialHash( size_t = 4 );
+	void	resize( Map& );
+	void	clear();
+	void	update( size_t, sf::Vector2f );
+	void	remove( size_t );
+	void	queryAABB( sf::FloatRect, std::vector<size_t>& ) const;
+	void	queryRadius( sf::Vector2f, float, std::vector<size_t>& ) const;
+	size_t getCellSize() { return mCellSize; }
+
+private:
+	size_t	getCell( sf::Vector2f ) const;
+	void	getCellRange( sf::FloatRect, size_t&, size_t&, size_t&, size_t& ) const;
+
+	size_t				 mCellTiles;
+	size_t				 mCellSize;
+	size_t				 mCellsWide;
+	size_t				 mCellsHigh;
+	float				 mMargin;
+	std::vector<std::vector<size_t>> mCells;
+	std::vector<sf::Vector2f>	 mPositions;
+	std::vector<size_t>		 mEntityCell;
+	std::vector<size_t>		 mEntitySlot;
+};
+
+#endif
@@ -0,0 +1,407 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/System.hpp>
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+
+#include "random.hpp"
+#include "map.hpp"
+#include "stream.hpp"
+
+//Where along the east or south edge of a chunk a hallway crosses into its neighbour, or -1 if it's walled off.
+//Both chunks work it out from the same coordinates so they always agree
+static int getDoor( unsigned int seed, int x, int y, sf::Uint32 edge, size_t size )
+{
+	sf::Uint32 h = RandomStream::at( RandomStream::makeKey( seed, edge, RandomStream::packCoord( x, y ) ), 0 );
+
+	//The rows and columns through the spawn are always open so it can't be walled in
+	bool open = ( edge == STREAM_CHUNK_EDGE_EAST ? y == 0 : x == 0 ) || ( h & 3 ) != 0;
+
+	return open ? 3 + ( h >> 2 ) % ( size - 8 ) : -1;
+}
+
+static void carve( std::vector<sf::Uint8>& tiles, size_t size, int x, int y, int w, int h )
+{
+	int i, j;
+
+	for( j = std::max( y, 0 ); j < std::min( y + h, (int)size ); j++ )
+	{
+		for( i = std::max( x, 0 ); i < std::min( x + w, (int)size ); i++ )
+		{
+			tiles[( j * size ) + i] = TILE_FLOOR;
+		}
+	}
+}
+
+//A room somewhere in the chunk with a two tile wide hallway out to every open edge
+void ChunkStreamer::generate( unsigned int seed, size_t size, DungeonChunk& chunk )
+{
+	int x = chunk.coord.x, y = chunk.coord.y;
+	RandomStream random( RandomStream::makeKey( seed, STREAM_CHUNK_ROOM, RandomStream::packCoord( x, y ) ) );
+	sf::IntRect room;
+	int i, door;
+
+	chunk.tiles.assign( size * size, TILE_NONE );
+
+	//The spawn room is always in the middle of the first chunk
+	if( x == 0 && y == 0 )
+	{
+		room = sf::IntRect( ( size / 2 ) - 5, ( size / 2 ) - 5, 10, 10 );
+	}
+	else
+	{
+		room.width  = random.nextInt( 6, size / 2 );
+		room.height = random.nextInt( 6, size / 2 );
+		room.left   = random.nextInt( 2, size - 2 - room.width );
+		room.top    = random.nextInt( 2, size - 2 - room.height );
+	}
+
+	carve( chunk.tiles, size, room.left, room.top, room.width, room.height );
+
+	int centerX = room.left + ( room.width / 2 );
+	int centerY = room.top + ( room.height / 2 );
+
+	//Out to the east and west edges along the door's row, then over to the room
+	if( ( door = getDoor( seed, x, y, STREAM_CHUNK_EDGE_EAST, size ) ) >= 0 )
+	{
+		carve( chunk.tiles, size, centerX, door, size - centerX, 2 );
+		carve( chunk.tiles, size, centerX, std::min( door, centerY ), 2, std::abs( door - centerY ) + 2 );
+	}
+
+	if( ( door = getDoor( seed, x - 1, y, STREAM_CHUNK_EDGE_EAST, size ) ) >= 0 )
+	{
+		carve( chunk.tiles, size, 0, door, centerX + 2, 2 );
+		carve( chunk.tiles, size, centerX, std::min( door, centerY ), 2, std::abs( door - centerY ) + 2 );
+	}
+
+	//Likewise for the north and south edges along the door's column
+	if( ( door = getDoor( seed, x, y, STREAM_CHUNK_EDGE_SOUTH, size ) ) >= 0 )
+	{
+		carve( chunk.tiles, size, door, centerY, 2, size - centerY );
+		carve( chunk.tiles, size, std::min( door, centerX ), centerY, std::abs( door - centerX ) + 2, 2 );
+	}
+
+	if( ( door = getDoor( seed, x, y - 1, STREAM_CHUNK_EDGE_SOUTH, size ) ) >= 0 )
+	{
+		carve( chunk.tiles, size, door, 0, 2, centerY + 2 );
+		carve( chunk.tiles, size, std::min( door, centerX ), centerY, std::abs( door - centerX ) + 2, 2 );
+	}
+
+	if( x == 0 && y == 0 )
+	{
+		chunk.tiles[( centerY * size ) + centerX] = TILE_PLAYER_SPAWN;
+		return;
+	}
+
+	for( i = random.nextInt( 0, 3 ); i > 0; i-- )
+	{
+		int ex = random.nextInt( room.left, room.left + room.width - 1 );
+		int ey = random.nextInt( room.top, room.top + room.height - 1 );
+
+		chunk.tiles[( ey * size ) + ex] = TILE_ENEMY_SPAWN;
+	}
+}
+
+ChunkStreamer::ChunkStreamer( size_t chunkSize )
+{
+	mChunkSize  = chunkSize;
+	mSeed	    = 0;
+	mRunning    = false;
+	mStallCount = 0;
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+	stop();
+}
+
+//Forget every chunk and start the worker on a new seed
+void ChunkStreamer::start( unsigned int seed )
+{
+	stop();
+
+	mSeed	    = seed;
+	mRunning    = true;
+	mStallCount = 0;
+	mWorker	    = std::thread( &ChunkStreamer::run, this );
+}
+
+void ChunkStreamer::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		mRunning = false;
+		mWake.notify_all();
+	}
+
+	if( mWorker.joinable() )
+	{
+		mWorker.join();
+	}
+
+	mQueue.clear();
+	mPending.clear();
+	mChunks.clear();
+}
+
+//Ask for a chunk to be generated in the background if we don't have it and nobody is working on it
+void ChunkStreamer::request( sf::Vector2i coord )
+{
+	Key key( coord.x, coord.y );
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	if( mChunks.count( key ) != 0 || mPending.count( key ) != 0 )
+	{
+		return;
+	}
+
+	mPending.insert( key );
+	mQueue.push_back( key );
+	mWake.notify_one();
+}
+
+//Get a chunk we need right now. If the worker hasn't got to it yet we make it ourselves, and
+//if it's in the middle of making it we wait. The reference is good until the chunk is evicted
+const DungeonChunk& ChunkStreamer::acquire( sf::Vector2i coord )
+{
+	Key key( coord.x, coord.y );
+	std::unique_lock<std::mutex> lock( mMutex );
+	auto it = mChunks.find( key );
+
+	if( it != mChunks.end() )
+	{
+		return *it->second;
+	}
+
+	mStallCount++;
+
+	auto queued = std::find( mQueue.begin(), mQueue.end(), key );
+
+	if( queued != mQueue.end() || mPending.count( key ) == 0 )
+	{
+		if( queued != mQueue.end() )
+		{
+			mQueue.erase( queued );
+		}
+
+		mPending.insert( key );
+		lock.unlock();
+
+		std::unique_ptr<DungeonChunk> chunk( new DungeonChunk );
+		chunk->coord = coord;
+		generate( mSeed, mChunkSize, *chunk );
+
+		lock.lock();
+		mPending.erase( key );
+		mChunks[key] = std::move( chunk );
+	}
+
+	while( mChunks.count( key ) == 0 )
+	{
+		mReady.wait( lock );
+	}
+
+	return *mChunks[key];
+}
+
+//Throw away every chunk outside the given range of chunk coordinates, and stop waiting on any that haven't been started
+void ChunkStreamer::evict( sf::IntRect keep )
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	for( auto it = mChunks.begin(); it != mChunks.end(); )
+	{
+		if( !keep.contains( it->first.first, it->first.second ) )
+		{
+			it = mChunks.erase( it );
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	for( auto it = mQueue.begin(); it != mQueue.end(); )
+	{
+		if( !keep.contains( it->first, it->second ) )
+		{
+			mPending.erase( *it );
+			it = mQueue.erase( it );
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
+size_t ChunkStreamer::getResidentCount()
+{
+	std::lock_guard<std::mutex> lock( mMutex );
+
+	return mChunks.size();
+}
+
+//The worker, makes whatever is at the front of the queue without holding the lock
+void ChunkStreamer::run()
+{
+	std::unique_lock<std::mutex> lock( mMutex );
+
+	while( mRunning )
+	{
+		if( mQueue.empty() )
+		{
+			mWake.wait( lock );
+			continue;
+		}
+
+		Key key = mQueue.front();
+		mQueue.pop_front();
+		lock.unlock();
+
+		std::unique_ptr<DungeonChunk> chunk( new DungeonChunk );
+		chunk->coord = sf::Vector2i( key.first, key.second );
+		generate( mSeed, mChunkSize, *chunk );
+
+		lock.lock();
+		mPending.erase( key );
+		mChunks[key] = std::move( chunk );
+		mReady.notify_all();
+	}
+}
+
+//The window is chunks by chunks chunks, an odd number so the player can be in the middle one
+StreamedDungeon::StreamedDungeon( size_t chunks, size_t chunkSize ) : DungeonMap( chunks * chunkSize, chunks * chunkSize ), mStreamer( chunkSize )
+{
+	mChunks	   = chunks;
+	mChunkSize = chunkSize;
+}
+
+//Start over on a new seed with the spawn chunk in the middle of the window
+void StreamedDungeon::generate( unsigned int seed )
+{
+	int half = mChunks / 2;
+
+	mSeed = seed;
+	mStreamer.start( seed );
+
+	clear();
+	load( sf::Vector2i( -half, -half ), sf::IntRect() );
+	findPlayerSpawn();
+}
+
+//The range of chunk coordinates a window starting at origin covers
+sf::IntRect StreamedDungeon::getWindow( sf::Vector2i origin )
+{
+	return sf::IntRect( origin.x, origin.y, mChunks, mChunks );
+}
+
+//Slide the window so it starts at origin, copying in every chunk it now covers and noting which ones weren't in before
+void StreamedDungeon::load( sf::Vector2i origin, sf::IntRect before )
+{
+	size_t i, j;
+
+	mFresh.clear();
+
+	for( j = 0; j < mChunks; j++ )
+	{
+		for( i = 0; i < mChunks; i++ )
+		{
+			sf::Vector2i coord = origin + sf::Vector2i( i, j );
+			const DungeonChunk& chunk = mStreamer.acquire( coord );
+
+			setTiles( i * mChunkSize, j * mChunkSize, mChunkSize, mChunkSize, &chunk.tiles[0] );
+
+			if( !before.contains( coord ) )
+			{
+				mFresh.push_back( sf::IntRect( i * mChunkSize, j * mChunkSize, mChunkSize, mChunkSize ) );
+			}
+		}
+	}
+
+	mOrigin = origin;
+}
+
+//Call every step with where the player is and where it's heading. Asks for the chunks the window will need
+//next, and once the player reaches the outer ring of chunks recenters the window on it.
+//Returns how many tiles everything has to move back by, which is nothing most of the time
+sf::Vector2i StreamedDungeon::update( sf::Vector2f position, sf::Vector2f velocity )
+{
+	int half = mChunks / 2;
+	sf::Vector2i tile   = getTileCoordForPoint( position );
+	sf::Vector2i chunk  = mOrigin + sf::Vector2i( tile.x / (int)mChunkSize, tile.y / (int)mChunkSize );
+	sf::Vector2i center = mOrigin + sf::Vector2i( half, half );
+	sf::Vector2i ahead( ( velocity.x > 0 ) - ( velocity.x < 0 ), ( velocity.y > 0 ) - ( velocity.y < 0 ) );
+
+	mFresh.clear();
+
+	//The window we'd recenter to if the player keeps going this way, closest chunks first
+	if( ahead != sf::Vector2i( 0, 0 ) )
+	{
+		sf::Vector2i next = center + ( ahead * half );
+		int ring, i, j;
+
+		for( ring = 0; ring <= half; ring++ )
+		{
+			for( j = -ring; j <= ring; j++ )
+			{
+				for( i = -ring; i <= ring; i++ )
+				{
+					if( std::abs( i ) == ring || std::abs( j ) == ring )
+					{
+						mStreamer.request( next + sf::Vector2i( i, j ) );
+					}
+				}
+			}
+		}
+	}
+
+	if( std::abs( chunk.x - center.x ) < half && std::abs( chunk.y - center.y ) < half )
+	{
+		return sf::Vector2i( 0, 0 );
+	}
+
+	sf::Vector2i shift = chunk - center;
+
+	load( chunk - sf::Vector2i( half, half ), getWindow( mOrigin ) );
+
+	//Keep what's around the new window, both what we just left and what we might need next
+	mStreamer.evict( sf::IntRect( mOrigin.x - half, mOrigin.y - half, mChunks + ( half * 2 ), mChunks + ( half * 2 ) ) );
+
+	return shift * (int)mChunkSize;
+}
@@ -0,0 +1,95 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+//One square piece of an unbounded dungeon, tiles packed a row at a time
+struct DungeonChunk
+{
+	sf::Vector2i		coord;
+	std::vector<sf::Uint8>	tiles;
+};
+
+//Generates the chunks of an unbounded dungeon on a worker thread, ahead of when they're needed.
+//A chunk only depends on the seed and its coordinates, so it can be thrown away and made again later
+class ChunkStreamer
+{
+public:
+	ChunkStreamer( size_t = 32 );
+	~ChunkStreamer();
+	void			start( unsigned int );
+	void			stop();
+	void			request( sf::Vector2i );
+	const DungeonChunk&	acquire( sf::Vector2i );
+	void			evict( sf::IntRect );
+	size_t getChunkSize() { return mChunkSize; }
+	size_t getResidentCount();
+	size_t getStallCount() { return mStallCount; }
+	static void		generate( unsigned int, size_t, DungeonChunk& );
+
+private:
+	typedef std::pair<int, int> Key;
+
+	void			run();
+
+	size_t					 mChunkSize;
+	unsigned int				 mSeed;
+	bool					 mRunning;
+	size_t					 mStallCount;
+	std::thread				 mWorker;
+	std::mutex				 mMutex;
+	std::condition_variable			 mWake;
+	std::condition_variable			 mReady;
+	std::deque<Key>				 mQueue;
+	std::set<Key>				 mPending;
+	std::map<Key, std::unique_ptr<DungeonChunk>> mChunks;
+};
+
+//A window of chunks around the player that slides along as it walks, so only the area
+//around it is ever in memory. Tile coordinates are relative to the window's top left chunk
+class StreamedDungeon : public DungeonMap
+{
+public:
+	StreamedDungeon( size_t = 5, size_t = 32 );
+	void		generate( unsigned int );
+	sf::Vector2i	update( sf::Vector2f, sf::Vector2f );
+	const std::vector<sf::IntRect>& getFreshAreas() { return mFresh; }
+	sf::Vector2i getOrigin() { return mOrigin; }
+	ChunkStreamer& getStreamer() { return mStreamer; }
+
+private:
+	void		load( sf::Vector2i, sf::IntRect );
+	sf::IntRect	getWindow( sf::Vector2i );
+
+	ChunkStreamer			mStreamer;
+	size_t				mChunks;
+	size_t				mChunkSize;
+	sf::Vector2i			mOrigin;
+	std::vector<sf::IntRect>	mFresh;
+};
+
+#endif
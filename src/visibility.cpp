@@ -0,0 +1,253 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#include <SFML/Window.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/System.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+
+#include "random.hpp"
+#include "map.hpp"
+#include "visibility.hpp"
+
+//How each of the eight octants maps onto the map's axes
+static const int gOctants[8][4] = {
+	{  1,  0,  0,  1 },
+	{  0,  1,  1,  0 },
+	{  0, -1,  1,  0 },
+	{ -1,  0,  0,  1 },
+	{ -1,  0,  0, -1 },
+	{  0, -1, -1,  0 },
+	{  0,  1, -1,  0 },
+	{  1,  0,  0, -1 }
+};
+
+//Radius is in tiles
+Visibility::Visibility( size_t radius )
+{
+	mRadius	      = radius;
+	mWidth	      = 0;
+	mHeight	      = 0;
+	mWordsPerRow  = 0;
+	mOpacityValid = false;
+	mFieldValid   = false;
+	mComputeCount = 0;
+}
+
+void Visibility::resize( Map& map )
+{
+	mWidth	     = map.getWidth();
+	mHeight	     = map.getHeight();
+	mWordsPerRow = ( mWidth + 63 ) / 64;
+
+	mVisible.assign( mWordsPerRow * mHeight, 0 );
+	buildOpacity( map );
+}
+
+//Anything that can't be walked on blocks sight, so opacity is the map's walkable bits flipped
+void Visibility::buildOpacity( Map& map )
+{
+	size_t i, y;
+
+	mOpaque.resize( mWordsPerRow * mHeight );
+
+	for( y = 0; y < mHeight; y++ )
+	{
+		const sf::Uint64 *row = map.getWalkableRow( y );
+
+		for( i = 0; i < mWordsPerRow; i++ )
+		{
+			mOpaque[( y * mWordsPerRow ) + i] = ~row[i];
+		}
+	}
+
+	mOpacityValid = true;
+	mFieldValid   = false;
+}
+
+//Anything off the map blocks sight
+bool Visibility::isOpaque( int x, int y ) const
+{
+	if( x < 0 || y < 0 || x >= (int)mWidth || y >= (int)mHeight )
+	{
+		return true;
+	}
+
+	return ( mOpaque[( y * mWordsPerRow ) + ( x / 64 )] >> ( x % 64 ) ) & 1;
+}
+
+void Visibility::setVisible( int x, int y )
+{
+	if( x >= 0 && y >= 0 && x < (int)mWidth && y < (int)mHeight )
+	{
+		mVisible[( y * mWordsPerRow ) + ( x / 64 )] |= (sf::Uint64)1 << ( x % 64 );
+	}
+}
+
+//Recompute the field of view if the viewer moved to another tile or the map changed since last time
+bool Visibility::update( Map& map, sf::Vector2i viewer )
+{
+	int octant, y;
+
+	if( !mOpacityValid )
+	{
+		buildOpacity( map );
+	}
+
+	if( mFieldValid && viewer == mViewer )
+	{
+		return false;
+	}
+
+	//Only the rows the last field could have reached need clearing
+	for( y = std::max( 0, mViewer.y - (int)mRadius ); y <= std::min( (int)mHeight - 1, mViewer.y + (int)mRadius ); y++ )
+	{
+		std::fill( mVisible.begin() + ( y * mWordsPerRow ), mVisible.begin() + ( ( y + 1 ) * mWordsPerRow ), 0 );
+	}
+
+	mViewer	    = viewer;
+	mFieldValid = true;
+	mComputeCount++;
+
+	setVisible( viewer.x, viewer.y );
+
+	for( octant = 0; octant < 8; octant++ )
+	{
+		castLight( 1, 1.0f, 0.0f, gOctants[octant][0], gOctants[octant][1], gOctants[octant][2], gOctants[octant][3] );
+	}
+
+	return true;
+}
+
+//Scan one octant row by row, recursing to scan around each run of opaque tiles
+void Visibility::castLight( int row, float start, float end, int xx, int xy, int yx, int yy )
+{
+	int   radius   = mRadius;
+	int   j, dx, dy;
+	float newStart = 0.0f;
+	bool  blocked  = false;
+
+	if( start < end )
+	{
+		return;
+	}
+
+	for( j = row; j <= radius && !blocked; j++ )
+	{
+		dy = -j;
+
+		for( dx = -j; dx <= 0; dx++ )
+		{
+			int   x		 = mViewer.x + ( dx * xx ) + ( dy * xy );
+			int   y		 = mViewer.y + ( dx * yx ) + ( dy * yy );
+			float leftSlope	 = ( dx - 0.5f ) / ( dy + 0.5f );
+			float rightSlope = ( dx + 0.5f ) / ( dy - 0.5f );
+
+			if( start < rightSlope )
+			{
+				continue;
+			}
+			else if( end > leftSlope )
+			{
+				break;
+			}
+
+			if( ( dx * dx ) + ( dy * dy ) <= radius * radius )
+			{
+				setVisible( x, y );
+			}
+
+			if( blocked )
+			{
+				if( isOpaque( x, y ) )
+				{
+					newStart = rightSlope;
+				}
+				else
+				{
+					blocked = false;
+					start	= newStart;
+				}
+			}
+			else if( isOpaque( x, y ) && j < radius )
+			{
+				blocked = true;
+				castLight( j + 1, start, leftSlope, xx, xy, yx, yy );
+				newStart = rightSlope;
+			}
+		}
+	}
+}
+
+//Whether a tile was in the field of view at the last update
+bool Visibility::isVisible( sf::Vector2i tile ) const
+{
+	if( tile.x < 0 || tile.y < 0 || tile.x >= (int)mWidth || tile.y >= (int)mHeight )
+	{
+		return false;
+	}
+
+	return ( mVisible[( tile.y * mWordsPerRow ) + ( tile.x / 64 )] >> ( tile.x % 64 ) ) & 1;
+}
+
+//Walk the line between two tiles, blocked if any tile strictly between them is opaque
+bool Visibility::hasLineOfSight( sf::Vector2i from, sf::Vector2i to ) const
+{
+	int dx	  = std::abs( to.x - from.x );
+	int dy	  = -std::abs( to.y - from.y );
+	int stepX = from.x < to.x ? 1 : -1;
+	int stepY = from.y < to.y ? 1 : -1;
+	int error = dx + dy;
+	int x	  = from.x;
+	int y	  = from.y;
+
+	while( x != to.x || y != to.y )
+	{
+		int error2 = error * 2;
+
+		if( error2 >= dy )
+		{
+			error += dy;
+			x     += stepX;
+		}
+
+		if( error2 <= dx )
+		{
+			error += dx;
+			y     += stepY;
+		}
+
+		if( ( x != to.x || y != to.y ) && isOpaque( x, y ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,62 @@
+/*
+    The MIT License (MIT)
+
+    Copyright (c) 2013 Max Rose
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+    THE SOFTWARE.
+
+    This file is part of Nozoki.
+*/
+
+#ifndef VISIBILITY_HPP
+#define VISIBILITY_HPP
+
+//Field of view from a viewer's tile by recursive shadowcasting, plus point to point line of sight,
+//both worked out on a grid of one opacity bit per tile
+class Visibility
+{
+public:
+	Visibility( size_t = 8 );
+	void	resize( Map& );
+	void	invalidate() { mOpacityValid = false; }
+	bool	update( Map&, sf::Vector2i );
+	bool	isVisible( sf::Vector2i ) const;
+	bool	hasLineOfSight( sf::Vector2i, sf::Vector2i ) const;
+	size_t getRadius() { return mRadius; }
+	size_t getComputeCount() { return mComputeCount; }
+
+private:
+	void	buildOpacity( Map& );
+	bool	isOpaque( int, int ) const;
+	void	setVisible( int, int );
+	void	castLight( int, float, float, int, int, int, int );
+
+	size_t			mRadius;
+	size_t			mWidth;
+	size_t			mHeight;
+	size_t			mWordsPerRow;
+	sf::Vector2i		mViewer;
+	bool			mOpacityValid;
+	bool			mFieldValid;
+	size_t			mComputeCount;
+	std::vector<sf::Uint64>	mOpaque;
+	std::vector<sf::Uint64>	mVisible;
+};
+
+#endif